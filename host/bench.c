@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013 Bert Freudenberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Render benchmark for the watchface update procs.
+//
+//   bench [-n ticks] [-k key=value]... [-b percent] [-p] [-o screen.ppm] [-v]
+//
+// Runs the face for the given number of one-second ticks after the startup
+// animation and prints the cost of each update proc. Settings are preloaded
+// into persistent storage with -k, using the app keys from appinfo.json,
+// e.g. -k 0=2 for seconds always on.
+
+#include "pebble_host.h"
+
+#include <unistd.h>
+
+// from src/pebble_one.c, whose main is renamed by the Makefile
+void handle_init();
+void handle_deinit();
+void background_layer_update_callback(Layer *layer, GContext *ctx);
+void hands_layer_update_callback(Layer *layer, GContext *ctx);
+void seconds_layer_update_callback(Layer *layer, GContext *ctx);
+void date_layer_update_callback(Layer *layer, GContext *ctx);
+void battery_layer_update_callback(Layer *layer, GContext *ctx);
+
+static void write_screen(const char *filename) {
+  static GColor8 pixels[HOST_SCREEN_W * HOST_SCREEN_H];
+  host_read_screen(pixels);
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    perror(filename);
+    return;
+  }
+  fprintf(file, "P6\n%d %d\n3\n", HOST_SCREEN_W, HOST_SCREEN_H);
+  for (int i = 0; i < HOST_SCREEN_W * HOST_SCREEN_H; i++) {
+    uint8_t rgb[3] = { pixels[i].r, pixels[i].g, pixels[i].b };
+    fwrite(rgb, 1, 3, file);
+  }
+  fclose(file);
+}
+
+int main(int argc, char **argv) {
+  int ticks = 3600;
+  int battery = 80;
+  bool plugged = false;
+  const char *screen = NULL;
+  time_t start = 1452425400; // 2016-01-10 11:30:00 UTC, a Sunday
+
+  host_init(start);
+  int opt;
+  while ((opt = getopt(argc, argv, "n:k:b:po:v")) != -1) {
+    switch (opt) {
+      case 'n': ticks = atoi(optarg); break;
+      case 'b': battery = atoi(optarg); break;
+      case 'p': plugged = true; break;
+      case 'o': screen = optarg; break;
+      case 'v': host_verbose = true; break;
+      case 'k': {
+        int key, value;
+        if (sscanf(optarg, "%d=%d", &key, &value) != 2) {
+          fprintf(stderr, "bad setting '%s', expected key=value\n", optarg);
+          return 1;
+        }
+        persist_write_int(key, value);
+        break;
+      }
+      default:
+        fprintf(stderr, "usage: %s [-n ticks] [-k key=value]... [-b percent] [-p] [-o screen.ppm] [-v]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  host_name_proc(background_layer_update_callback, "background");
+  host_name_proc(hands_layer_update_callback, "hands");
+  host_name_proc(seconds_layer_update_callback, "seconds");
+  host_name_proc(date_layer_update_callback, "date");
+  host_name_proc(battery_layer_update_callback, "battery");
+
+  host_set_battery(battery, plugged, plugged);
+  handle_init();
+  host_set_focus(true);
+  host_advance(1000); // let the startup animation finish
+  host_reset_counters();
+  for (int i = 0; i < ticks; i++)
+    host_advance(1000);
+  if (screen) write_screen(screen);
+
+  int count;
+  const HostProcStats *stats = host_proc_stats(&count);
+  uint32_t frames = host_counters.frames ? host_counters.frames : 1;
+  printf("%s %dx%d, %d ticks, %u frames\n",
+    PBL_IF_COLOR_ELSE(PBL_IF_ROUND_ELSE("chalk", "basalt"), "aplite"),
+    HOST_SCREEN_W, HOST_SCREEN_H, ticks, host_counters.frames);
+  printf("%-14s %8s %9s %9s %9s %10s %10s %8s\n",
+    "proc", "calls", "avg us", "min us", "max us", "draws/f", "pixels/f", "gpath/f");
+  for (int i = 0; i < count; i++) {
+    const HostProcStats *s = &stats[i];
+    if (!s->calls) continue;
+    printf("%-14s %8u %9.2f %9.2f %9.2f %10.1f %10.1f %8.1f\n",
+      s->name, s->calls,
+      s->ns_total / 1000.0 / s->calls, s->ns_min / 1000.0, s->ns_max / 1000.0,
+      (double) s->counters.draw_calls / frames,
+      (double) s->counters.pixels / frames,
+      (double) s->counters.gpath_calls / frames);
+  }
+  printf("%-14s %8u %9s %9s %9s %10.1f %10.1f %8.1f\n",
+    "total", host_counters.layer_procs, "", "", "",
+    (double) host_counters.draw_calls / frames,
+    (double) host_counters.pixels / frames,
+    (double) host_counters.gpath_calls / frames);
+  if (host_counters.outbox_sends)
+    printf("outbox %u messages, %u bytes\n", host_counters.outbox_sends, host_counters.outbox_bytes);
+  if (host_counters.vibes)
+    printf("vibes %u, %u ms\n", host_counters.vibes, host_counters.vibe_ms);
+
+  handle_deinit();
+  return 0;
+}
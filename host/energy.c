@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2013 Bert Freudenberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Energy estimate for a scripted day on the wrist.
+//
+//   energy [-c name=weight]... [-m budget] [-v] day.txt
+//
+// Replays the script (see day.txt for the format) against the face with
+// one-second ticks in between, counts what costs power on the watch and
+// weighs it with the cost model below, which -c overrides per item. The
+// weights are relative, not calibrated. With -m it fails if the total is
+// above the budget, which is how the Makefile catches regressions.
+
+#include "pebble_host.h"
+
+#include <unistd.h>
+
+// from src/pebble_one.c, whose main is renamed by the Makefile
+void handle_init();
+void handle_deinit();
+void background_layer_update_callback(Layer *layer, GContext *ctx);
+void hands_layer_update_callback(Layer *layer, GContext *ctx);
+void seconds_layer_update_callback(Layer *layer, GContext *ctx);
+void date_layer_update_callback(Layer *layer, GContext *ctx);
+void battery_layer_update_callback(Layer *layer, GContext *ctx);
+
+#define DAY_START 1452384000 // 2016-01-10 00:00:00 UTC, a Sunday
+#define DAY_MS    (24 * 3600 * 1000)
+
+// cost of each counted item, in relative units
+static struct {
+  const char *name;
+  double weight;
+  double count;
+} costs[] = {
+  { "wakeup",        100 }, // cpu out of sleep
+  { "frame",         200 }, // window redraw and display update
+  { "layer",          20 }, // each update proc run
+  { "kpixel",          5 }, // thousand framebuffer pixels written
+  { "timer",          10 }, // app timer registered or rescheduled
+  { "vibe_ms",        20 }, // motor on
+  { "persist_read",   50 },
+  { "persist_write", 500 }, // flash erase and write
+  { "outbox_send",  1000 }, // radio
+  { "outbox_byte",     5 },
+};
+
+static void set_count(const char *name, double count) {
+  for (unsigned i = 0; i < ARRAY_LENGTH(costs); i++)
+    if (!strcmp(costs[i].name, name)) costs[i].count = count;
+}
+
+static bool set_weight(const char *arg) {
+  char name[32];
+  double weight;
+  if (sscanf(arg, "%31[^=]=%lf", name, &weight) != 2) return false;
+  for (unsigned i = 0; i < ARRAY_LENGTH(costs); i++) {
+    if (!strcmp(costs[i].name, name)) {
+      costs[i].weight = weight;
+      return true;
+    }
+  }
+  return false;
+}
+
+// apply one script line, false if it does not parse
+static bool replay(char *line, uint32_t *at_ms) {
+  int h, m, s, n;
+  if (sscanf(line, "%d:%d:%d %n", &h, &m, &s, &n) != 3) return false;
+  uint32_t ms = ((h * 60 + m) * 60 + s) * 1000;
+  if (ms < *at_ms || ms > DAY_MS) return false;
+  host_advance(ms - *at_ms);
+  *at_ms = ms;
+  char *event = strtok(line + n, " \t\n");
+  char *arg = strtok(NULL, " \t\n");
+  if (!event || !arg) return false;
+  if (!strcmp(event, "battery")) {
+    bool charging = false, plugged = false;
+    for (char *flag = strtok(NULL, " \t\n"); flag; flag = strtok(NULL, " \t\n")) {
+      if (!strcmp(flag, "charging")) charging = true;
+      else if (!strcmp(flag, "plugged")) plugged = true;
+      else return false;
+    }
+    host_set_battery(atoi(arg), charging, plugged);
+  } else if (!strcmp(event, "bluetooth")) {
+    host_set_connected(!strcmp(arg, "on"));
+  } else if (!strcmp(event, "focus")) {
+    host_set_focus(!strcmp(arg, "on"));
+  } else if (!strcmp(event, "wrist")) {
+    host_set_moving(!strcmp(arg, "on"));
+  } else if (!strcmp(event, "tap")) {
+    host_tap(ACCEL_AXIS_Y, atoi(arg));
+  } else if (!strcmp(event, "config")) {
+    Tuplet tuplets[16];
+    int count = 0;
+    for (; arg && count < 16; arg = strtok(NULL, " \t\n")) {
+      int key, value;
+      if (sscanf(arg, "%d=%d", &key, &value) != 2) return false;
+      Tuplet tuplet = TupletInteger(key, (int32_t) value);
+      memcpy(&tuplets[count++], &tuplet, sizeof(tuplet)); // Tuplet fields are const
+    }
+    host_receive_message(tuplets, count);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  double budget = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:m:v")) != -1) {
+    switch (opt) {
+      case 'c':
+        if (!set_weight(optarg)) {
+          fprintf(stderr, "bad cost '%s', expected name=weight\n", optarg);
+          return 1;
+        }
+        break;
+      case 'm': budget = atof(optarg); break;
+      case 'v': host_verbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-c name=weight]... [-m budget] [-v] day.txt\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-c name=weight]... [-m budget] [-v] day.txt\n", argv[0]);
+    return 1;
+  }
+  const char *script = argv[optind];
+  FILE *file = fopen(script, "r");
+  if (!file) {
+    perror(script);
+    return 1;
+  }
+
+  host_init(DAY_START);
+  host_name_proc(background_layer_update_callback, "background");
+  host_name_proc(hands_layer_update_callback, "hands");
+  host_name_proc(seconds_layer_update_callback, "seconds");
+  host_name_proc(date_layer_update_callback, "date");
+  host_name_proc(battery_layer_update_callback, "battery");
+
+  handle_init();
+  uint32_t at_ms = 0;
+  char line[256];
+  for (int number = 1; fgets(line, sizeof(line), file); number++) {
+    char *p = line + strspn(line, " \t");
+    if (*p == '#' || *p == '\n' || !*p) continue;
+    if (!replay(p, &at_ms)) {
+      fprintf(stderr, "%s:%d: bad event\n", script, number);
+      return 1;
+    }
+  }
+  fclose(file);
+  host_advance(DAY_MS - at_ms);
+  handle_deinit();
+
+  int count;
+  const HostProcStats *stats = host_proc_stats(&count);
+  printf("%s, %s\n", PBL_IF_COLOR_ELSE(PBL_IF_ROUND_ELSE("chalk", "basalt"), "aplite"), script);
+  printf("%-14s %10s\n", "layer", "redraws");
+  for (int i = 0; i < count; i++)
+    if (stats[i].calls) printf("%-14s %10u\n", stats[i].name, stats[i].calls);
+
+  set_count("wakeup", host_counters.wakeups);
+  set_count("frame", host_counters.frames);
+  set_count("layer", host_counters.layer_procs);
+  set_count("kpixel", host_counters.pixels / 1000.0);
+  set_count("timer", host_counters.timers);
+  set_count("vibe_ms", host_counters.vibe_ms);
+  set_count("persist_read", host_counters.persist_reads);
+  set_count("persist_write", host_counters.persist_writes);
+  set_count("outbox_send", host_counters.outbox_sends);
+  set_count("outbox_byte", host_counters.outbox_bytes);
+  double total = 0;
+  printf("%-14s %10s %8s %12s\n", "item", "count", "weight", "cost");
+  for (unsigned i = 0; i < ARRAY_LENGTH(costs); i++) {
+    double cost = costs[i].count * costs[i].weight;
+    total += cost;
+    printf("%-14s %10.0f %8g %12.0f\n", costs[i].name, costs[i].count, costs[i].weight, cost);
+  }
+  printf("%-14s %10s %8s %12.0f\n", "total", "", "", total);
+  if (budget && total > budget) {
+    printf("over budget by %.1f%%\n", (total / budget - 1) * 100);
+    return 1;
+  }
+  return 0;
+}
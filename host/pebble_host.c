@@ -0,0 +1,1482 @@
+/*
+ * Copyright (c) 2013 Bert Freudenberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Software implementation of the Pebble API subset declared in pebble.h.
+// Like the firmware, any dirty layer causes the whole window to be redrawn
+// into a persistent framebuffer. The rasterizer is not pixel-exact with the
+// firmware, but it touches the same number of pixels to within a few percent,
+// which is what the benchmark compares.
+
+#include "pebble_host.h"
+
+#include <malloc.h>
+#include <math.h>
+#include <stdarg.h>
+
+#undef time
+
+HostCounters host_counters;
+bool host_verbose = false;
+
+static uint64_t now_ms;
+static time_t start_time;
+static size_t heap_base; // host allocations before the face starts
+
+#define MAX_PROCS 32
+static HostProcStats proc_stats[MAX_PROCS];
+static int proc_count;
+static HostProcStats *current_proc;
+
+static void count_draw(void) {
+  host_counters.draw_calls++;
+  if (current_proc) current_proc->counters.draw_calls++;
+}
+
+static void count_gpath(void) {
+  host_counters.gpath_calls++;
+  if (current_proc) current_proc->counters.gpath_calls++;
+}
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+time_t host_time(time_t *tloc) {
+  time_t t = start_time + (time_t) (now_ms / 1000);
+  if (tloc) *tloc = t;
+  return t;
+}
+
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms) {
+  uint16_t ms = now_ms % 1000;
+  host_time(t_utc);
+  if (out_ms) *out_ms = ms;
+  return ms;
+}
+
+uint64_t host_now_ms(void) {
+  return now_ms;
+}
+
+// everything malloc'd since host_init, by the face or by the runtime on its
+// behalf, so the numbers follow the face's allocations but not the sizes of
+// the firmware's own structures
+size_t heap_bytes_used(void) {
+  size_t used = mallinfo2().uordblks;
+  return used > heap_base ? used - heap_base : 0;
+}
+
+size_t heap_bytes_free(void) {
+  size_t used = heap_bytes_used();
+  return used < HOST_HEAP_BYTES ? HOST_HEAP_BYTES - used : 0;
+}
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...) {
+  if (!host_verbose) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "[%6.3f] %s:%d ", now_ms / 1000.0, src_filename, src_line_number);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+// geometry
+
+bool gpoint_equal(const GPoint * const point_a, const GPoint * const point_b) {
+  return point_a->x == point_b->x && point_a->y == point_b->y;
+}
+
+bool grect_equal(const GRect * const rect_a, const GRect * const rect_b) {
+  return gpoint_equal(&rect_a->origin, &rect_b->origin)
+    && rect_a->size.w == rect_b->size.w && rect_a->size.h == rect_b->size.h;
+}
+
+bool grect_is_empty(const GRect * const rect) {
+  return rect->size.w <= 0 || rect->size.h <= 0;
+}
+
+void grect_clip(GRect * const rect_to_clip, const GRect * const rect_clipper) {
+  int x0 = rect_to_clip->origin.x, y0 = rect_to_clip->origin.y;
+  int x1 = x0 + rect_to_clip->size.w, y1 = y0 + rect_to_clip->size.h;
+  int cx0 = rect_clipper->origin.x, cy0 = rect_clipper->origin.y;
+  int cx1 = cx0 + rect_clipper->size.w, cy1 = cy0 + rect_clipper->size.h;
+  if (x0 < cx0) x0 = cx0;
+  if (y0 < cy0) y0 = cy0;
+  if (x1 > cx1) x1 = cx1;
+  if (y1 > cy1) y1 = cy1;
+  *rect_to_clip = GRect(x0, y0, x1 > x0 ? x1 - x0 : 0, y1 > y0 ? y1 - y0 : 0);
+}
+
+void grect_align(GRect *rect, const GRect *inside_rect, const GAlign alignment, const bool clip) {
+  int dx = inside_rect->size.w - rect->size.w;
+  int dy = inside_rect->size.h - rect->size.h;
+  int x = inside_rect->origin.x, y = inside_rect->origin.y;
+  switch (alignment) {
+    case GAlignCenter:      x += dx / 2; y += dy / 2; break;
+    case GAlignTopLeft:     break;
+    case GAlignTopRight:    x += dx; break;
+    case GAlignTop:         x += dx / 2; break;
+    case GAlignLeft:        y += dy / 2; break;
+    case GAlignBottom:      x += dx / 2; y += dy; break;
+    case GAlignRight:       x += dx; y += dy / 2; break;
+    case GAlignBottomRight: x += dx; y += dy; break;
+    case GAlignBottomLeft:  y += dy; break;
+  }
+  rect->origin = GPoint(x, y);
+  if (clip) grect_clip(rect, inside_rect);
+}
+
+GPoint grect_center_point(const GRect *rect) {
+  return GPoint(rect->origin.x + rect->size.w / 2, rect->origin.y + rect->size.h / 2);
+}
+
+// trigonometry
+
+int32_t sin_lookup(int32_t angle) {
+  return (int32_t) lround(sin(angle * 2 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+int32_t cos_lookup(int32_t angle) {
+  return (int32_t) lround(cos(angle * 2 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+bool gcolor_equal(GColor8 x, GColor8 y) {
+  return x.argb == y.argb;
+}
+
+// bitmaps
+
+struct GBitmap {
+  GBitmapFormat format;
+  uint16_t row_size_bytes;
+  GRect bounds;
+  uint8_t *addr;
+  GColor *palette;
+  bool owns_data;
+  bool owns_palette;
+};
+
+static int format_bits(GBitmapFormat format) {
+  switch (format) {
+    case GBitmapFormat1Bit:
+    case GBitmapFormat1BitPalette: return 1;
+    case GBitmapFormat2BitPalette: return 2;
+    case GBitmapFormat4BitPalette: return 4;
+    default: return 8;
+  }
+}
+
+static uint16_t row_size_for(GBitmapFormat format, int width) {
+  if (format == GBitmapFormat1Bit) return (width + 31) / 32 * 4;
+  return (width * format_bits(format) + 7) / 8;
+}
+
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format) {
+  GBitmap *bitmap = calloc(1, sizeof(GBitmap));
+  bitmap->format = format;
+  bitmap->row_size_bytes = row_size_for(format, size.w);
+  bitmap->bounds = GRect(0, 0, size.w, size.h);
+  bitmap->addr = calloc(size.h, bitmap->row_size_bytes);
+  bitmap->owns_data = true;
+  int colors = format_bits(format) < 8 ? 1 << format_bits(format) : 0;
+  if (format != GBitmapFormat1Bit && colors) {
+    bitmap->palette = calloc(colors, sizeof(GColor));
+    bitmap->owns_palette = true;
+  }
+  return bitmap;
+}
+
+GBitmap *gbitmap_create_blank_with_palette(GSize size, GBitmapFormat format, GColor *palette, bool free_on_destroy) {
+  GBitmap *bitmap = gbitmap_create_blank(size, format);
+  gbitmap_set_palette(bitmap, palette, free_on_destroy);
+  return bitmap;
+}
+
+GBitmap *gbitmap_create_as_sub_bitmap(const GBitmap *base_bitmap, GRect sub_rect) {
+  GBitmap *bitmap = malloc(sizeof(GBitmap));
+  *bitmap = *base_bitmap;
+  grect_clip(&sub_rect, &base_bitmap->bounds);
+  bitmap->bounds = sub_rect;
+  bitmap->owns_data = false;
+  bitmap->owns_palette = false;
+  return bitmap;
+}
+
+void gbitmap_destroy(GBitmap *bitmap) {
+  if (!bitmap) return;
+  if (bitmap->owns_data) free(bitmap->addr);
+  if (bitmap->owns_palette) free(bitmap->palette);
+  free(bitmap);
+}
+
+uint8_t *gbitmap_get_data(const GBitmap *bitmap) { return bitmap->addr; }
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap) { return bitmap->row_size_bytes; }
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap) { return bitmap->format; }
+GRect gbitmap_get_bounds(const GBitmap *bitmap) { return bitmap->bounds; }
+void gbitmap_set_bounds(GBitmap *bitmap, GRect bounds) { bitmap->bounds = bounds; }
+GColor *gbitmap_get_palette(const GBitmap *bitmap) { return bitmap->palette; }
+
+void gbitmap_set_palette(GBitmap *bitmap, GColor *palette, bool free_on_destroy) {
+  if (bitmap->format == GBitmapFormat1Bit) return; // no palette on aplite
+  if (bitmap->owns_palette) free(bitmap->palette);
+  bitmap->palette = palette;
+  bitmap->owns_palette = free_on_destroy;
+}
+
+GBitmapDataRowInfo gbitmap_get_data_row_info(const GBitmap *bitmap, uint16_t y) {
+  // circular buffers are stored as full rectangular rows on the host, so only
+  // the reported visible span differs
+  GBitmapDataRowInfo info = {
+    bitmap->addr + y * bitmap->row_size_bytes, 0, bitmap->bounds.size.w - 1 };
+  if (bitmap->format == GBitmapFormat8BitCircular) {
+    int r = bitmap->bounds.size.w / 2;
+    double dy = y + 0.5 - r;
+    int half = (int) sqrt(r * r - dy * dy > 0 ? r * r - dy * dy : 0);
+    info.min_x = r - half;
+    info.max_x = r + half - 1;
+  }
+  return info;
+}
+
+static GColor8 bitmap_get_pixel(const GBitmap *bitmap, int x, int y) {
+  const uint8_t *row = bitmap->addr + y * bitmap->row_size_bytes;
+  int bits = format_bits(bitmap->format);
+  if (bitmap->format == GBitmapFormat1Bit)
+    return (row[x / 8] >> (x % 8)) & 1 ? GColorWhite : GColorBlack;
+  if (bits == 8)
+    return (GColor8){.argb = row[x]};
+  int per_byte = 8 / bits;
+  int shift = (per_byte - 1 - x % per_byte) * bits;
+  int index = (row[x / per_byte] >> shift) & ((1 << bits) - 1);
+  return bitmap->palette ? bitmap->palette[index] : (index ? GColorWhite : GColorBlack);
+}
+
+static void bitmap_set_pixel(GBitmap *bitmap, int x, int y, GColor8 color) {
+  uint8_t *row = bitmap->addr + y * bitmap->row_size_bytes;
+  if (bitmap->format == GBitmapFormat1Bit) {
+    bool white = color.r + color.g + color.b >= 5; // same threshold as the firmware's dithering midpoint
+    if (white) row[x / 8] |= 1 << (x % 8); else row[x / 8] &= ~(1 << (x % 8));
+  } else {
+    row[x] = color.argb; // framebuffers are never palettized
+  }
+}
+
+// resources and fonts
+
+typedef struct {
+  uint32_t id;
+  int16_t w, h;
+} HostImageResource;
+
+static const HostImageResource image_resources[] = {
+  { RESOURCE_ID_IMAGE_MENU_ICON,     24, 28 },
+  { RESOURCE_ID_IMAGE_ATLAS,         61, 13 }, // see atlas.auto.h
+};
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id) {
+  for (size_t i = 0; i < sizeof(image_resources) / sizeof(image_resources[0]); i++) {
+    if (image_resources[i].id != resource_id) continue;
+    GBitmap *bitmap = gbitmap_create_blank(GSize(image_resources[i].w, image_resources[i].h),
+      PBL_IF_COLOR_ELSE(GBitmapFormat1BitPalette, GBitmapFormat1Bit));
+    if (bitmap->palette) {
+      bitmap->palette[0] = GColorBlack;
+      bitmap->palette[1] = GColorWhite;
+    }
+    // the artwork is not decoded, a checkerboard has a similar ink coverage
+    for (int y = 0; y < image_resources[i].h; y++)
+      for (int x = 0; x < image_resources[i].w; x++)
+        if ((x + y) & 1) {
+          if (bitmap->format == GBitmapFormat1Bit)
+            bitmap->addr[y * bitmap->row_size_bytes + x / 8] |= 1 << (x % 8);
+          else
+            bitmap->addr[y * bitmap->row_size_bytes + x / 8] |= 0x80 >> (x % 8);
+        }
+    return bitmap;
+  }
+  return NULL;
+}
+
+ResHandle resource_get_handle(uint32_t resource_id) {
+  return (ResHandle) (uintptr_t) resource_id;
+}
+
+GFont fonts_load_custom_font(ResHandle handle) {
+  return (GFont) handle;
+}
+
+void fonts_unload_custom_font(GFont font) {
+}
+
+GFont fonts_get_system_font(const char *font_key) {
+  return (GFont) font_key;
+}
+
+// graphics
+
+struct GContext {
+  GBitmap *framebuffer;
+  GRect clip;     // absolute
+  GPoint offset;  // absolute origin of the layer bounds
+  GColor8 stroke_color;
+  GColor8 fill_color;
+  GColor8 text_color;
+  GCompOp compositing_mode;
+  bool antialiased;
+  uint8_t stroke_width;
+  bool captured;
+};
+
+static GContext context;
+static GBitmap *framebuffer;
+
+static const GContext default_draw_state = {
+  .stroke_color = {.argb = GColorBlackARGB8},
+  .fill_color = {.argb = GColorBlackARGB8},
+  .text_color = {.argb = GColorWhiteARGB8},
+  .compositing_mode = GCompOpAssign,
+  .antialiased = true,
+  .stroke_width = 1,
+};
+
+static void put_pixel(GContext *ctx, int x, int y, GColor8 color) {
+  x += ctx->offset.x;
+  y += ctx->offset.y;
+  if (x < ctx->clip.origin.x || y < ctx->clip.origin.y
+    || x >= ctx->clip.origin.x + ctx->clip.size.w || y >= ctx->clip.origin.y + ctx->clip.size.h)
+    return;
+  bitmap_set_pixel(ctx->framebuffer, x, y, color);
+  host_counters.pixels++;
+  if (current_proc) current_proc->counters.pixels++;
+}
+
+static void fill_span(GContext *ctx, int x0, int x1, int y, GColor8 color) {
+  for (int x = x0; x <= x1; x++)
+    put_pixel(ctx, x, y, color);
+}
+
+void graphics_context_set_stroke_color(GContext *ctx, GColor color) { ctx->stroke_color = color; }
+void graphics_context_set_fill_color(GContext *ctx, GColor color) { ctx->fill_color = color; }
+void graphics_context_set_text_color(GContext *ctx, GColor color) { ctx->text_color = color; }
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode) { ctx->compositing_mode = mode; }
+void graphics_context_set_antialiased(GContext *ctx, bool enable) { ctx->antialiased = enable; }
+void graphics_context_set_stroke_width(GContext *ctx, uint8_t stroke_width) { ctx->stroke_width = stroke_width; }
+
+void graphics_draw_pixel(GContext *ctx, GPoint point) {
+  count_draw();
+  put_pixel(ctx, point.x, point.y, ctx->stroke_color);
+}
+
+static void draw_line(GContext *ctx, GPoint p0, GPoint p1) {
+  int dx = abs(p1.x - p0.x), sx = p0.x < p1.x ? 1 : -1;
+  int dy = -abs(p1.y - p0.y), sy = p0.y < p1.y ? 1 : -1;
+  int err = dx + dy;
+  int x = p0.x, y = p0.y;
+  for (;;) {
+    put_pixel(ctx, x, y, ctx->stroke_color);
+    if (x == p1.x && y == p1.y) break;
+    int e2 = 2 * err;
+    if (e2 >= dy) { err += dy; x += sx; }
+    if (e2 <= dx) { err += dx; y += sy; }
+  }
+}
+
+// wide strokes have round caps, like the firmware's: every pixel within half
+// the width of the segment
+static void draw_wide_line(GContext *ctx, GPoint p0, GPoint p1) {
+  int r = ctx->stroke_width / 2;
+  int dx = p1.x - p0.x, dy = p1.y - p0.y, length2 = dx * dx + dy * dy;
+  int left = dx < 0 ? p1.x : p0.x, top = dy < 0 ? p1.y : p0.y;
+  for (int y = top - r; y <= top + abs(dy) + r; y++)
+    for (int x = left - r; x <= left + abs(dx) + r; x++) {
+      int t = (x - p0.x) * dx + (y - p0.y) * dy; // projection, scaled by length2
+      t = t < 0 ? 0 : t > length2 ? length2 : t;
+      double ex = x - p0.x - (length2 ? (double) t * dx / length2 : 0);
+      double ey = y - p0.y - (length2 ? (double) t * dy / length2 : 0);
+      if (ex * ex + ey * ey <= r * r + r)
+        put_pixel(ctx, x, y, ctx->stroke_color);
+    }
+}
+
+void graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1) {
+  count_draw();
+  if (ctx->stroke_width > 1)
+    draw_wide_line(ctx, p0, p1);
+  else
+    draw_line(ctx, p0, p1);
+}
+
+void graphics_draw_rect(GContext *ctx, GRect rect) {
+  count_draw();
+  int x1 = rect.origin.x + rect.size.w - 1, y1 = rect.origin.y + rect.size.h - 1;
+  draw_line(ctx, rect.origin, GPoint(x1, rect.origin.y));
+  draw_line(ctx, GPoint(x1, rect.origin.y), GPoint(x1, y1));
+  draw_line(ctx, GPoint(x1, y1), GPoint(rect.origin.x, y1));
+  draw_line(ctx, GPoint(rect.origin.x, y1), rect.origin);
+}
+
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius, GCornerMask corner_mask) {
+  count_draw();
+  for (int y = rect.origin.y; y < rect.origin.y + rect.size.h; y++)
+    fill_span(ctx, rect.origin.x, rect.origin.x + rect.size.w - 1, y, ctx->fill_color);
+}
+
+void graphics_draw_circle(GContext *ctx, GPoint p, uint16_t radius) {
+  count_draw();
+  int x = radius, y = 0, err = 1 - x;
+  while (x >= y) {
+    GPoint octants[8] = {
+      {p.x + x, p.y + y}, {p.x + y, p.y + x}, {p.x - y, p.y + x}, {p.x - x, p.y + y},
+      {p.x - x, p.y - y}, {p.x - y, p.y - x}, {p.x + y, p.y - x}, {p.x + x, p.y - y} };
+    for (int i = 0; i < 8; i++)
+      put_pixel(ctx, octants[i].x, octants[i].y, ctx->stroke_color);
+    y++;
+    if (err < 0) err += 2 * y + 1; else { x--; err += 2 * (y - x) + 1; }
+  }
+}
+
+void graphics_fill_circle(GContext *ctx, GPoint p, uint16_t radius) {
+  count_draw();
+  int r2 = radius * radius + radius;
+  for (int dy = -radius; dy <= radius; dy++) {
+    int dx = (int) sqrt(r2 - dy * dy);
+    fill_span(ctx, p.x - dx, p.x + dx, p.y + dy, ctx->fill_color);
+  }
+}
+
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect rect) {
+  count_draw();
+  if (!bitmap) return;
+  GRect src = bitmap->bounds;
+  for (int y = 0; y < rect.size.h; y++)
+    for (int x = 0; x < rect.size.w; x++) {
+      // bitmaps are tiled to fill the rectangle
+      GColor8 color = bitmap_get_pixel(bitmap,
+        src.origin.x + x % src.size.w, src.origin.y + y % src.size.h);
+      bool set = gcolor_equal(color, GColorWhite);
+      switch (ctx->compositing_mode) {
+        case GCompOpAssign: break;
+        case GCompOpAssignInverted: color.argb ^= 0x3f; break;
+        case GCompOpOr: if (!set) continue; break;
+        case GCompOpAnd: if (set) continue; break;
+        case GCompOpClear: if (!set) continue; color = GColorBlack; break;
+        case GCompOpSet: if (color.a == 0) continue; break;
+      }
+      put_pixel(ctx, rect.origin.x + x, rect.origin.y + y, color);
+    }
+}
+
+void graphics_draw_text(GContext *ctx, const char *text, GFont const font, const GRect box,
+    const GTextOverflowMode overflow_mode, const GTextAlignment alignment,
+    GTextAttributes *text_attributes) {
+  // glyphs are not rasterized, only counted
+  count_draw();
+}
+
+// a rough 16x30 cell per glyph, good enough for sizing what gets redrawn
+GSize graphics_text_layout_get_content_size(const char *text, GFont const font, const GRect box,
+    const GTextOverflowMode overflow_mode, const GTextAlignment alignment) {
+  int glyphs = 0;
+  for (const char *c = text; *c; c++)
+    if ((*c & 0xC0) != 0x80) glyphs++;
+  return GSize(glyphs * 16 < box.size.w ? glyphs * 16 : box.size.w, 30 < box.size.h ? 30 : box.size.h);
+}
+
+GBitmap *graphics_capture_frame_buffer(GContext *ctx) {
+  if (ctx->captured) return NULL;
+  ctx->captured = true;
+  return ctx->framebuffer;
+}
+
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer) {
+  if (!ctx->captured || buffer != ctx->framebuffer) return false;
+  ctx->captured = false;
+  return true;
+}
+
+// paths
+
+GPath *gpath_create(const GPathInfo *init) {
+  count_gpath();
+  // like the firmware, the path keeps pointing at the caller's points
+  GPath *path = calloc(1, sizeof(GPath));
+  path->num_points = init->num_points;
+  path->points = init->points;
+  return path;
+}
+
+void gpath_destroy(GPath *path) {
+  count_gpath();
+  free(path);
+}
+
+void gpath_rotate_to(GPath *path, int32_t angle) {
+  count_gpath();
+  path->rotation = angle;
+}
+
+void gpath_move_to(GPath *path, GPoint point) {
+  count_gpath();
+  path->offset = point;
+}
+
+static int transformed_points(const GPath *path, GPoint *out) {
+  int32_t cos = cos_lookup(path->rotation), sin = sin_lookup(path->rotation);
+  for (uint32_t i = 0; i < path->num_points; i++) {
+    GPoint p = path->points[i];
+    out[i] = GPoint(
+      (p.x * cos - p.y * sin) / TRIG_MAX_RATIO + path->offset.x,
+      (p.x * sin + p.y * cos) / TRIG_MAX_RATIO + path->offset.y);
+  }
+  return path->num_points;
+}
+
+void gpath_draw_filled(GContext *ctx, GPath *path) {
+  count_gpath();
+  count_draw();
+  GPoint points[path->num_points];
+  int n = transformed_points(path, points);
+  int y_min = points[0].y, y_max = points[0].y;
+  for (int i = 1; i < n; i++) {
+    if (points[i].y < y_min) y_min = points[i].y;
+    if (points[i].y > y_max) y_max = points[i].y;
+  }
+  // even-odd scanline fill sampled at pixel centers
+  for (int y = y_min; y <= y_max; y++) {
+    int xs[n], count = 0;
+    for (int i = 0; i < n; i++) {
+      GPoint a = points[i], b = points[(i + 1) % n];
+      if ((a.y <= y) == (b.y <= y)) continue;
+      xs[count++] = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+    }
+    for (int i = 1; i < count; i++)
+      for (int j = i; j > 0 && xs[j - 1] > xs[j]; j--) {
+        int t = xs[j]; xs[j] = xs[j - 1]; xs[j - 1] = t;
+      }
+    for (int i = 0; i + 1 < count; i += 2)
+      fill_span(ctx, xs[i], xs[i + 1], y, ctx->fill_color);
+  }
+}
+
+static void draw_path(GContext *ctx, GPath *path, bool closed) {
+  count_gpath();
+  count_draw();
+  GPoint points[path->num_points];
+  int n = transformed_points(path, points);
+  for (int i = 0; i + 1 < n; i++)
+    draw_line(ctx, points[i], points[i + 1]);
+  if (closed && n > 1)
+    draw_line(ctx, points[n - 1], points[0]);
+}
+
+void gpath_draw_outline(GContext *ctx, GPath *path) {
+  draw_path(ctx, path, true);
+}
+
+void gpath_draw_outline_open(GContext *ctx, GPath *path) {
+  draw_path(ctx, path, false);
+}
+
+// layers and windows
+
+struct Layer {
+  GRect frame;
+  GRect bounds;
+  bool hidden;
+  LayerUpdateProc update_proc;
+  Layer *parent;
+  Layer *first_child;
+  Layer *next_sibling;
+  void *data;
+};
+
+struct Window {
+  Layer *root_layer;
+  GColor8 background_color;
+};
+
+static Window *top_window;
+static bool window_dirty;
+
+Layer *layer_create_with_data(GRect frame, size_t data_size) {
+  Layer *layer = calloc(1, sizeof(Layer) + data_size);
+  layer->frame = frame;
+  layer->bounds = GRect(0, 0, frame.size.w, frame.size.h);
+  layer->data = data_size ? layer + 1 : NULL;
+  return layer;
+}
+
+Layer *layer_create(GRect frame) {
+  return layer_create_with_data(frame, 0);
+}
+
+void layer_destroy(Layer *layer) {
+  if (!layer) return;
+  layer_remove_from_parent(layer);
+  free(layer);
+}
+
+void *layer_get_data(const Layer *layer) { return layer->data; }
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) { layer->update_proc = update_proc; }
+GRect layer_get_frame(const Layer *layer) { return layer->frame; }
+GRect layer_get_bounds(const Layer *layer) { return layer->bounds; }
+bool layer_get_hidden(const Layer *layer) { return layer->hidden; }
+
+void layer_mark_dirty(Layer *layer) {
+  window_dirty = true;
+}
+
+void layer_set_frame(Layer *layer, GRect frame) {
+  if (grect_equal(&frame, &layer->frame)) return;
+  // like the firmware, the bounds follow the frame size but keep their origin
+  layer->frame = frame;
+  layer->bounds.size = frame.size;
+  layer_mark_dirty(layer);
+}
+
+void layer_set_bounds(Layer *layer, GRect bounds) {
+  if (grect_equal(&bounds, &layer->bounds)) return;
+  layer->bounds = bounds;
+  layer_mark_dirty(layer);
+}
+
+void layer_set_hidden(Layer *layer, bool hidden) {
+  if (layer->hidden == hidden) return;
+  layer->hidden = hidden;
+  layer_mark_dirty(layer);
+}
+
+void layer_add_child(Layer *parent, Layer *child) {
+  layer_remove_from_parent(child);
+  child->parent = parent;
+  Layer **link = &parent->first_child;
+  while (*link) link = &(*link)->next_sibling;
+  *link = child;
+  layer_mark_dirty(parent);
+}
+
+void layer_remove_from_parent(Layer *child) {
+  if (!child->parent) return;
+  Layer **link = &child->parent->first_child;
+  while (*link && *link != child) link = &(*link)->next_sibling;
+  if (*link) *link = child->next_sibling;
+  child->parent = NULL;
+  child->next_sibling = NULL;
+  window_dirty = true;
+}
+
+struct BitmapLayer {
+  Layer *layer;
+  const GBitmap *bitmap;
+  GAlign alignment;
+  GColor8 background_color;
+  GCompOp compositing_mode;
+};
+
+static void bitmap_layer_update_proc(Layer *layer, GContext *ctx) {
+  BitmapLayer *bitmap_layer = *(BitmapLayer **) layer_get_data(layer);
+  if (bitmap_layer->background_color.a) {
+    graphics_context_set_fill_color(ctx, bitmap_layer->background_color);
+    graphics_fill_rect(ctx, layer->bounds, 0, GCornerNone);
+  }
+  if (!bitmap_layer->bitmap) return;
+  GRect rect = gbitmap_get_bounds(bitmap_layer->bitmap);
+  rect.origin = GPointZero;
+  grect_align(&rect, &layer->bounds, bitmap_layer->alignment, false);
+  graphics_context_set_compositing_mode(ctx, bitmap_layer->compositing_mode);
+  graphics_draw_bitmap_in_rect(ctx, bitmap_layer->bitmap, rect);
+}
+
+BitmapLayer *bitmap_layer_create(GRect frame) {
+  BitmapLayer *bitmap_layer = calloc(1, sizeof(BitmapLayer));
+  bitmap_layer->layer = layer_create_with_data(frame, sizeof(BitmapLayer *));
+  *(BitmapLayer **) layer_get_data(bitmap_layer->layer) = bitmap_layer;
+  bitmap_layer->alignment = GAlignCenter;
+  bitmap_layer->compositing_mode = GCompOpAssign;
+  layer_set_update_proc(bitmap_layer->layer, bitmap_layer_update_proc);
+  return bitmap_layer;
+}
+
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer) {
+  layer_destroy(bitmap_layer->layer);
+  free(bitmap_layer);
+}
+
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer) {
+  return bitmap_layer->layer;
+}
+
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap) {
+  bitmap_layer->bitmap = bitmap;
+  layer_mark_dirty(bitmap_layer->layer);
+}
+
+void bitmap_layer_set_alignment(BitmapLayer *bitmap_layer, GAlign alignment) {
+  bitmap_layer->alignment = alignment;
+  layer_mark_dirty(bitmap_layer->layer);
+}
+
+void bitmap_layer_set_background_color(BitmapLayer *bitmap_layer, GColor color) {
+  bitmap_layer->background_color = color;
+  layer_mark_dirty(bitmap_layer->layer);
+}
+
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode) {
+  bitmap_layer->compositing_mode = mode;
+  layer_mark_dirty(bitmap_layer->layer);
+}
+
+struct TextLayer {
+  Layer *layer;
+  const char *text;
+  GFont font;
+  GColor8 text_color;
+  GColor8 background_color;
+};
+
+static void text_layer_update_proc(Layer *layer, GContext *ctx) {
+  TextLayer *text_layer = *(TextLayer **) layer_get_data(layer);
+  if (text_layer->background_color.a) {
+    graphics_context_set_fill_color(ctx, text_layer->background_color);
+    graphics_fill_rect(ctx, layer->bounds, 0, GCornerNone);
+  }
+  graphics_context_set_text_color(ctx, text_layer->text_color);
+  if (text_layer->text)
+    graphics_draw_text(ctx, text_layer->text, text_layer->font, layer->bounds,
+      GTextOverflowModeWordWrap, GTextAlignmentLeft, NULL);
+}
+
+TextLayer *text_layer_create(GRect frame) {
+  TextLayer *text_layer = calloc(1, sizeof(TextLayer));
+  text_layer->layer = layer_create_with_data(frame, sizeof(TextLayer *));
+  *(TextLayer **) layer_get_data(text_layer->layer) = text_layer;
+  text_layer->text_color = GColorBlack;
+  text_layer->background_color = GColorWhite;
+  layer_set_update_proc(text_layer->layer, text_layer_update_proc);
+  return text_layer;
+}
+
+void text_layer_destroy(TextLayer *text_layer) {
+  layer_destroy(text_layer->layer);
+  free(text_layer);
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer) { return text_layer->layer; }
+void text_layer_set_text(TextLayer *text_layer, const char *text) { text_layer->text = text; layer_mark_dirty(text_layer->layer); }
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) { text_layer->text_color = color; layer_mark_dirty(text_layer->layer); }
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) { text_layer->background_color = color; layer_mark_dirty(text_layer->layer); }
+void text_layer_set_font(TextLayer *text_layer, GFont font) { text_layer->font = font; layer_mark_dirty(text_layer->layer); }
+
+Window *window_create(void) {
+  Window *window = calloc(1, sizeof(Window));
+  window->root_layer = layer_create(GRect(0, 0, HOST_SCREEN_W, HOST_SCREEN_H));
+  window->background_color = GColorWhite;
+  return window;
+}
+
+void window_destroy(Window *window) {
+  if (window == top_window) top_window = NULL;
+  layer_destroy(window->root_layer);
+  free(window);
+}
+
+Layer *window_get_root_layer(const Window *window) {
+  return window->root_layer;
+}
+
+void window_set_background_color(Window *window, GColor background_color) {
+  if (gcolor_equal(window->background_color, background_color)) return;
+  window->background_color = background_color;
+  window_dirty = true;
+}
+
+void window_stack_push(Window *window, bool animated) {
+  top_window = window;
+  window_dirty = true;
+}
+
+void app_event_loop(void) {
+}
+
+static HostProcStats *stats_for(LayerUpdateProc proc) {
+  for (int i = 0; i < proc_count; i++)
+    if (proc_stats[i].proc == proc) return &proc_stats[i];
+  if (proc_count == MAX_PROCS) return NULL;
+  HostProcStats *stats = &proc_stats[proc_count++];
+  stats->proc = proc;
+  stats->name = proc == bitmap_layer_update_proc ? "bitmap_layer"
+    : proc == text_layer_update_proc ? "text_layer" : "?";
+  stats->ns_min = UINT64_MAX;
+  return stats;
+}
+
+static void render_layer(Layer *layer, GRect clip, GPoint origin) {
+  if (layer->hidden) return;
+  GRect frame = layer->frame;
+  frame.origin = GPoint(origin.x + frame.origin.x, origin.y + frame.origin.y);
+  grect_clip(&clip, &frame);
+  GPoint offset = GPoint(frame.origin.x + layer->bounds.origin.x, frame.origin.y + layer->bounds.origin.y);
+  if (layer->update_proc && !grect_is_empty(&clip)) {
+    context = default_draw_state;
+    context.framebuffer = framebuffer;
+    context.clip = clip;
+    context.offset = offset;
+    HostProcStats *stats = stats_for(layer->update_proc);
+    current_proc = stats;
+    uint64_t start = monotonic_ns();
+    layer->update_proc(layer, &context);
+    uint64_t elapsed = monotonic_ns() - start;
+    current_proc = NULL;
+    host_counters.layer_procs++;
+    if (stats) {
+      stats->calls++;
+      stats->ns_total += elapsed;
+      if (elapsed < stats->ns_min) stats->ns_min = elapsed;
+      if (elapsed > stats->ns_max) stats->ns_max = elapsed;
+    }
+  }
+  for (Layer *child = layer->first_child; child; child = child->next_sibling)
+    render_layer(child, clip, offset);
+}
+
+static void render(void) {
+  if (!window_dirty || !top_window) return;
+  window_dirty = false;
+  host_counters.frames++;
+  GRect screen = GRect(0, 0, HOST_SCREEN_W, HOST_SCREEN_H);
+  for (int y = 0; y < HOST_SCREEN_H; y++)
+    for (int x = 0; x < HOST_SCREEN_W; x++)
+      bitmap_set_pixel(framebuffer, x, y, top_window->background_color);
+  render_layer(top_window->root_layer, screen, GPointZero);
+}
+
+void host_read_screen(GColor8 *pixels) {
+  for (int y = 0; y < HOST_SCREEN_H; y++)
+    for (int x = 0; x < HOST_SCREEN_W; x++)
+      pixels[y * HOST_SCREEN_W + x] = bitmap_get_pixel(framebuffer, x, y);
+}
+
+// animations
+
+struct Animation {
+  const AnimationImplementation *implementation;
+  AnimationCurve curve;
+  uint32_t duration_ms;
+  uint32_t delay_ms;
+  uint64_t start_ms;
+  bool scheduled;
+  bool started;
+  Animation *next;
+};
+
+static Animation *animations;
+
+Animation *animation_create(void) {
+  Animation *animation = calloc(1, sizeof(Animation));
+  animation->curve = AnimationCurveDefault;
+  animation->duration_ms = 250;
+  animation->next = animations;
+  animations = animation;
+  return animation;
+}
+
+bool animation_destroy(Animation *animation) {
+  if (!animation) return false;
+  // unlinked lazily, animations may destroy themselves during teardown
+  animation->scheduled = false;
+  animation->implementation = NULL;
+  return true;
+}
+
+bool animation_set_curve(Animation *animation, AnimationCurve curve) { animation->curve = curve; return true; }
+bool animation_set_duration(Animation *animation, uint32_t duration_ms) { animation->duration_ms = duration_ms; return true; }
+bool animation_set_delay(Animation *animation, uint32_t delay_ms) { animation->delay_ms = delay_ms; return true; }
+bool animation_is_scheduled(Animation *animation) { return animation->scheduled; }
+
+bool animation_set_implementation(Animation *animation, const AnimationImplementation *implementation) {
+  animation->implementation = implementation;
+  return true;
+}
+
+bool animation_schedule(Animation *animation) {
+  animation->scheduled = true;
+  animation->started = false;
+  animation->start_ms = now_ms + animation->delay_ms;
+  return true;
+}
+
+static void animation_finish(Animation *animation) {
+  animation->scheduled = false;
+  if (animation->implementation && animation->implementation->teardown)
+    animation->implementation->teardown(animation);
+}
+
+bool animation_unschedule(Animation *animation) {
+  if (!animation->scheduled) return false;
+  animation_finish(animation);
+  return true;
+}
+
+void animation_unschedule_all(void) {
+  for (Animation *animation = animations; animation; animation = animation->next)
+    if (animation->scheduled) animation_finish(animation);
+}
+
+static AnimationProgress curve(AnimationCurve curve, AnimationProgress t) {
+  int64_t max = ANIMATION_NORMALIZED_MAX;
+  switch (curve) {
+    case AnimationCurveEaseIn: return t * (int64_t) t / max;
+    case AnimationCurveEaseOut: return max - (max - t) * (max - t) / max;
+    case AnimationCurveEaseInOut:
+      return t < max / 2 ? 2 * (int64_t) t * t / max : max - 2 * (max - t) * (max - t) / max;
+    default: return t;
+  }
+}
+
+static bool animations_running(void) {
+  for (Animation *animation = animations; animation; animation = animation->next)
+    if (animation->scheduled) return true;
+  return false;
+}
+
+static void animation_frame(void) {
+  for (Animation *animation = animations; animation; animation = animation->next) {
+    if (!animation->scheduled || now_ms < animation->start_ms) continue;
+    const AnimationImplementation *impl = animation->implementation;
+    if (!animation->started) {
+      animation->started = true;
+      if (impl && impl->setup) impl->setup(animation);
+    }
+    uint64_t elapsed = now_ms - animation->start_ms;
+    bool done = elapsed >= animation->duration_ms;
+    AnimationProgress progress = done ? ANIMATION_NORMALIZED_MAX
+      : (AnimationProgress) (elapsed * ANIMATION_NORMALIZED_MAX / animation->duration_ms);
+    if (impl && impl->update) impl->update(animation, curve(animation->curve, progress));
+    if (done) animation_finish(animation);
+  }
+}
+
+// timers
+
+struct AppTimer {
+  uint64_t due_ms;
+  AppTimerCallback callback;
+  void *data;
+  bool active;
+  AppTimer *next;
+};
+
+static AppTimer *timers;
+
+static AppTimer *timer_add(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  AppTimer *timer = calloc(1, sizeof(AppTimer));
+  timer->due_ms = now_ms + timeout_ms;
+  timer->callback = callback;
+  timer->data = callback_data;
+  timer->active = true;
+  timer->next = timers;
+  timers = timer;
+  return timer;
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  host_counters.timers++;
+  return timer_add(timeout_ms, callback, callback_data);
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+  if (!timer_handle || !timer_handle->active) return false;
+  host_counters.timers++;
+  timer_handle->due_ms = now_ms + new_timeout_ms;
+  return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  if (timer_handle) timer_handle->active = false;
+}
+
+static AppTimer *next_timer(void) {
+  AppTimer *next = NULL;
+  for (AppTimer *timer = timers; timer; timer = timer->next)
+    if (timer->active && (!next || timer->due_ms < next->due_ms)) next = timer;
+  return next;
+}
+
+static void reap_timers(void) {
+  AppTimer **link = &timers;
+  while (*link) {
+    if (!(*link)->active) {
+      AppTimer *dead = *link;
+      *link = dead->next;
+      free(dead);
+    } else {
+      link = &(*link)->next;
+    }
+  }
+}
+
+// event services
+
+static TimeUnits tick_units;
+static TickHandler tick_handler;
+static BatteryChargeState battery_state = { 80, false, false };
+static BatteryStateHandler battery_handler;
+static bool connected = true;
+static BluetoothConnectionHandler bluetooth_handler;
+static AppFocusHandlers focus_handlers;
+static AccelTapHandler tap_handler;
+static bool accel_sampling = false; // the data service is subscribed
+static bool moving = false;
+static AccelData accel = { 0, 0, -1000 }; // face up on a table
+
+void tick_timer_service_subscribe(TimeUnits tick_units_, TickHandler handler) {
+  tick_units = tick_units_;
+  tick_handler = handler;
+}
+
+void tick_timer_service_unsubscribe(void) {
+  tick_handler = NULL;
+}
+
+void battery_state_service_subscribe(BatteryStateHandler handler) { battery_handler = handler; }
+void battery_state_service_unsubscribe(void) { battery_handler = NULL; }
+BatteryChargeState battery_state_service_peek(void) { return battery_state; }
+
+void bluetooth_connection_service_subscribe(BluetoothConnectionHandler handler) { bluetooth_handler = handler; }
+void bluetooth_connection_service_unsubscribe(void) { bluetooth_handler = NULL; }
+bool bluetooth_connection_service_peek(void) { return connected; }
+
+void app_focus_service_subscribe_handlers(AppFocusHandlers handlers) { focus_handlers = handlers; }
+void app_focus_service_unsubscribe(void) { memset(&focus_handlers, 0, sizeof(focus_handlers)); }
+
+void accel_tap_service_subscribe(AccelTapHandler handler) { tap_handler = handler; }
+void accel_tap_service_unsubscribe(void) { tap_handler = NULL; }
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler) { accel_sampling = true; }
+void accel_data_service_unsubscribe(void) { accel_sampling = false; }
+int accel_service_set_sampling_rate(AccelSamplingRate rate) { return 0; }
+
+// on the wrist every peek finds the watch turned a bit, off it never moves
+int accel_service_peek(AccelData *data) {
+  if (!accel_sampling && !tap_handler) return -1;
+  if (moving) {
+    static uint32_t seed = 1;
+    seed = seed * 1103515245 + 12345;
+    accel.x = (int) (seed >> 16 & 0x1ff) - 256;
+    accel.y = (int) (seed >> 8 & 0x1ff) - 256;
+    accel.z = -900;
+  }
+  accel.did_vibrate = false;
+  accel.timestamp = (start_time + now_ms / 1000) * 1000 + now_ms % 1000;
+  *data = accel;
+  return 0;
+}
+
+void host_set_battery(uint8_t charge_percent, bool is_charging, bool is_plugged) {
+  battery_state = (BatteryChargeState) { charge_percent, is_charging, is_plugged };
+  if (battery_handler) {
+    host_counters.wakeups++;
+    battery_handler(battery_state);
+  }
+  render();
+}
+
+void host_set_connected(bool connected_) {
+  connected = connected_;
+  if (bluetooth_handler) {
+    host_counters.wakeups++;
+    bluetooth_handler(connected);
+  }
+  render();
+}
+
+void host_set_moving(bool moving_) {
+  moving = moving_;
+  if (!moving) accel = (AccelData) { 0, 0, -1000 };
+}
+
+void host_tap(AccelAxisType axis, int32_t direction) {
+  if (tap_handler) {
+    host_counters.wakeups++;
+    tap_handler(axis, direction);
+  }
+  render();
+}
+
+void host_set_focus(bool in_focus) {
+  if (focus_handlers.will_focus || focus_handlers.did_focus) host_counters.wakeups++;
+  if (focus_handlers.will_focus) focus_handlers.will_focus(in_focus);
+  if (focus_handlers.did_focus) focus_handlers.did_focus(in_focus);
+  render();
+}
+
+// vibration
+
+// durations as in the firmware
+static void vibe(uint32_t on_ms) {
+  host_counters.vibes++;
+  host_counters.vibe_ms += on_ms;
+}
+
+void vibes_short_pulse(void) { vibe(250); }
+void vibes_long_pulse(void) { vibe(500); }
+void vibes_double_pulse(void) { vibe(2 * 250); }
+void vibes_cancel(void) {}
+
+void vibes_enqueue_custom_pattern(VibePattern pattern) {
+  uint32_t on_ms = 0;
+  for (uint32_t i = 0; i < pattern.num_segments; i += 2)
+    on_ms += pattern.durations[i];
+  vibe(on_ms);
+}
+
+// dictionaries, laid out like the firmware: a count byte followed by packed tuples
+
+struct __attribute__((__packed__)) Dictionary {
+  uint8_t count;
+  Tuple head[];
+};
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  uint32_t total = sizeof(struct Dictionary) + tuple_count * sizeof(Tuple);
+  va_list args;
+  va_start(args, tuple_count);
+  for (int i = 0; i < tuple_count; i++)
+    total += va_arg(args, uint32_t);
+  va_end(args);
+  return total;
+}
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer, const uint16_t size) {
+  if (!iter || !buffer || size < sizeof(struct Dictionary)) return DICT_INVALID_ARGS;
+  iter->dictionary = (struct Dictionary *) buffer;
+  iter->dictionary->count = 0;
+  iter->cursor = iter->dictionary->head;
+  iter->end = buffer + size;
+  return DICT_OK;
+}
+
+static DictionaryResult dict_write(DictionaryIterator *iter, uint32_t key, TupleType type,
+    const void *data, uint16_t length) {
+  if ((uint8_t *) iter->cursor + sizeof(Tuple) + length > (uint8_t *) iter->end)
+    return DICT_NOT_ENOUGH_STORAGE;
+  iter->cursor->key = key;
+  iter->cursor->type = type;
+  iter->cursor->length = length;
+  memcpy(iter->cursor->value, data, length);
+  iter->cursor = (Tuple *) ((uint8_t *) iter->cursor + sizeof(Tuple) + length);
+  iter->dictionary->count++;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t * const data, const uint16_t size) {
+  return dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer, const uint8_t width_bytes, const bool is_signed) {
+  return dict_write(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+  return dict_write(iter, key, TUPLE_UINT, &value, 1);
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value) {
+  return dict_write(iter, key, TUPLE_INT, &value, 4);
+}
+
+DictionaryResult dict_write_tuplet(DictionaryIterator *iter, const Tuplet * const tuplet) {
+  switch (tuplet->type) {
+    case TUPLE_BYTE_ARRAY:
+      return dict_write(iter, tuplet->key, tuplet->type, tuplet->bytes.data, tuplet->bytes.length);
+    case TUPLE_CSTRING:
+      return dict_write(iter, tuplet->key, tuplet->type, tuplet->cstring.data, tuplet->cstring.length);
+    default:
+      return dict_write(iter, tuplet->key, tuplet->type, &tuplet->integer.storage, tuplet->integer.width);
+  }
+}
+
+uint32_t dict_write_end(DictionaryIterator *iter) {
+  iter->end = iter->cursor;
+  return (uint8_t *) iter->cursor - (uint8_t *) iter->dictionary;
+}
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size) {
+  iter->dictionary = (struct Dictionary *) buffer;
+  iter->end = buffer + size;
+  return dict_read_first(iter);
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter) {
+  iter->cursor = iter->dictionary->head;
+  return iter->dictionary->count ? iter->cursor : NULL;
+}
+
+Tuple *dict_read_next(DictionaryIterator *iter) {
+  Tuple *next = (Tuple *) ((uint8_t *) iter->cursor + sizeof(Tuple) + iter->cursor->length);
+  if ((const uint8_t *) next + sizeof(Tuple) > (const uint8_t *) iter->end) return NULL;
+  iter->cursor = next;
+  return next;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  DictionaryIterator copy = *iter;
+  for (Tuple *tuple = dict_read_first(&copy); tuple; tuple = dict_read_next(&copy))
+    if (tuple->key == key) return tuple;
+  return NULL;
+}
+
+// app messages
+
+static AppMessageInboxReceived inbox_received;
+static AppMessageOutboxSent outbox_sent;
+static AppMessageOutboxFailed outbox_failed;
+static uint8_t outbox_buffer[1024];
+static DictionaryIterator outbox_iter;
+static uint32_t outbox_size;
+static bool outbox_pending;
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+  outbox_size = size_outbound < sizeof(outbox_buffer) ? size_outbound : sizeof(outbox_buffer);
+  return APP_MSG_OK;
+}
+
+void app_message_deregister_callbacks(void) {
+  inbox_received = NULL;
+  outbox_sent = NULL;
+  outbox_failed = NULL;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+  AppMessageInboxReceived previous = inbox_received;
+  inbox_received = received_callback;
+  return previous;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback) { return NULL; }
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  AppMessageOutboxSent previous = outbox_sent;
+  outbox_sent = sent_callback;
+  return previous;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+  AppMessageOutboxFailed previous = outbox_failed;
+  outbox_failed = failed_callback;
+  return previous;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  *iterator = NULL;
+  if (!outbox_size) return APP_MSG_INVALID_STATE;
+  if (outbox_pending) return APP_MSG_BUSY;
+  dict_write_begin(&outbox_iter, outbox_buffer, outbox_size);
+  *iterator = &outbox_iter;
+  return APP_MSG_OK;
+}
+
+// the phone acks or the firmware gives up after a round trip
+static void outbox_done(void *data) {
+  outbox_pending = false;
+  if (connected) {
+    if (outbox_sent) outbox_sent(&outbox_iter, NULL);
+  } else {
+    if (outbox_failed) outbox_failed(&outbox_iter, APP_MSG_SEND_TIMEOUT, NULL);
+  }
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (!connected) return APP_MSG_NOT_CONNECTED;
+  if (outbox_pending) return APP_MSG_BUSY;
+  outbox_pending = true;
+  host_counters.outbox_sends++;
+  host_counters.outbox_bytes += (const uint8_t *) outbox_iter.end - outbox_buffer;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "outbox: %d bytes", (int) ((const uint8_t *) outbox_iter.end - outbox_buffer));
+  timer_add(HOST_OUTBOX_MS, outbox_done, NULL);
+  return APP_MSG_OK;
+}
+
+void host_receive_message(const Tuplet *tuplets, int count) {
+  static uint8_t buffer[1024];
+  DictionaryIterator iter;
+  dict_write_begin(&iter, buffer, sizeof(buffer));
+  for (int i = 0; i < count; i++)
+    dict_write_tuplet(&iter, &tuplets[i]);
+  uint32_t size = dict_write_end(&iter);
+  if (!inbox_received) return;
+  dict_read_begin_from_buffer(&iter, buffer, size);
+  host_counters.wakeups++;
+  inbox_received(&iter, NULL);
+  render();
+}
+
+// persistent storage
+
+#define MAX_PERSIST 64
+
+static struct {
+  uint32_t key;
+  int size;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} persist[MAX_PERSIST];
+static int persist_count;
+
+static int persist_find(uint32_t key) {
+  for (int i = 0; i < persist_count; i++)
+    if (persist[i].key == key) return i;
+  return -1;
+}
+
+bool persist_exists(const uint32_t key) {
+  return persist_find(key) >= 0;
+}
+
+int persist_get_size(const uint32_t key) {
+  int i = persist_find(key);
+  return i < 0 ? E_DOES_NOT_EXIST : persist[i].size;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size) {
+  int i = persist_find(key);
+  host_counters.persist_reads++;
+  if (i < 0) return E_DOES_NOT_EXIST;
+  int size = persist[i].size < (int) buffer_size ? persist[i].size : (int) buffer_size;
+  memcpy(buffer, persist[i].data, size);
+  return size;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size) {
+  int i = persist_find(key);
+  host_counters.persist_writes++;
+  if (i < 0) {
+    if (persist_count == MAX_PERSIST) return E_DOES_NOT_EXIST;
+    i = persist_count++;
+    persist[i].key = key;
+  }
+  persist[i].size = size < PERSIST_DATA_MAX_LENGTH ? size : PERSIST_DATA_MAX_LENGTH;
+  memcpy(persist[i].data, data, persist[i].size);
+  return persist[i].size;
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value) {
+  return persist_write_data(key, &value, sizeof(value));
+}
+
+status_t persist_delete(const uint32_t key) {
+  int i = persist_find(key);
+  if (i < 0) return E_DOES_NOT_EXIST;
+  host_counters.persist_writes++;
+  persist[i] = persist[--persist_count];
+  return S_SUCCESS;
+}
+
+// harness
+
+void host_init(time_t start) {
+  setenv("TZ", "UTC", 1);
+  tzset();
+  start_time = start;
+  now_ms = 0;
+  framebuffer = gbitmap_create_blank(GSize(HOST_SCREEN_W, HOST_SCREEN_H),
+    PBL_IF_COLOR_ELSE(PBL_IF_ROUND_ELSE(GBitmapFormat8BitCircular, GBitmapFormat8Bit), GBitmapFormat1Bit));
+  heap_base = mallinfo2().uordblks;
+}
+
+void host_reset_counters(void) {
+  memset(&host_counters, 0, sizeof(host_counters));
+  for (int i = 0; i < proc_count; i++) {
+    LayerUpdateProc proc = proc_stats[i].proc;
+    const char *name = proc_stats[i].name;
+    memset(&proc_stats[i], 0, sizeof(proc_stats[i]));
+    proc_stats[i].proc = proc;
+    proc_stats[i].name = name;
+    proc_stats[i].ns_min = UINT64_MAX;
+  }
+}
+
+void host_name_proc(LayerUpdateProc proc, const char *name) {
+  HostProcStats *stats = stats_for(proc);
+  if (stats) stats->name = name;
+}
+
+const HostProcStats *host_proc_stats(int *count) {
+  *count = proc_count;
+  return proc_stats;
+}
+
+static bool deliver_tick(uint64_t previous_ms) {
+  time_t before = start_time + (time_t) (previous_ms / 1000);
+  time_t after = host_time(NULL);
+  struct tm old_tm = *localtime(&before);
+  struct tm *tick_time = localtime(&after);
+  TimeUnits changed = SECOND_UNIT;
+  if (tick_time->tm_min != old_tm.tm_min) changed |= MINUTE_UNIT;
+  if (tick_time->tm_hour != old_tm.tm_hour) changed |= HOUR_UNIT;
+  if (tick_time->tm_mday != old_tm.tm_mday) changed |= DAY_UNIT;
+  if (tick_time->tm_mon != old_tm.tm_mon) changed |= MONTH_UNIT;
+  if (tick_time->tm_year != old_tm.tm_year) changed |= YEAR_UNIT;
+  if (!tick_handler || !(changed & tick_units)) return false;
+  tick_handler(tick_time, changed);
+  return true;
+}
+
+void host_advance(uint32_t ms) {
+  uint64_t end_ms = now_ms + ms;
+  uint64_t next_frame_ms = now_ms + HOST_FRAME_MS;
+  while (now_ms < end_ms) {
+    uint64_t next_ms = (now_ms / 1000 + 1) * 1000;
+    AppTimer *timer = next_timer();
+    if (timer && timer->due_ms < next_ms) next_ms = timer->due_ms;
+    bool animating = animations_running();
+    if (animating && next_frame_ms < next_ms) next_ms = next_frame_ms;
+    if (next_ms > end_ms) {
+      now_ms = end_ms;
+      break;
+    }
+    uint64_t previous_ms = now_ms;
+    now_ms = next_ms;
+    bool woke = false;
+    if (now_ms / 1000 != previous_ms / 1000)
+      woke = deliver_tick(previous_ms);
+    for (timer = next_timer(); timer && timer->due_ms <= now_ms; timer = next_timer()) {
+      timer->active = false;
+      timer->callback(timer->data);
+      woke = true;
+    }
+    reap_timers();
+    if (animating && now_ms >= next_frame_ms) {
+      animation_frame();
+      next_frame_ms = now_ms + HOST_FRAME_MS;
+      woke = true;
+    }
+    if (woke) host_counters.wakeups++;
+    render();
+  }
+}
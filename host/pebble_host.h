@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2013 Bert Freudenberg
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Harness side of the host runtime: drives the virtual clock and the
+// event services, and collects render statistics.
+
+#pragma once
+
+#include "pebble.h"
+
+#define HOST_SCREEN_W PBL_IF_ROUND_ELSE(180, 144)
+#define HOST_SCREEN_H PBL_IF_ROUND_ELSE(180, 168)
+
+// animation frame interval of the firmware
+#define HOST_FRAME_MS 33
+
+// app memory for code, data and heap, which heap_bytes_free() counts down from
+#define HOST_HEAP_BYTES PBL_IF_COLOR_ELSE(65536, 24576)
+
+// round trip until the phone acks an app message
+#define HOST_OUTBOX_MS 200
+
+typedef struct HostCounters {
+  uint32_t frames;        // full window redraws
+  uint32_t layer_procs;   // update procs run
+  uint32_t draw_calls;    // graphics_* and gpath_draw_* calls
+  uint32_t gpath_calls;   // all gpath_* calls, including rotate and move
+  uint32_t pixels;        // framebuffer pixels written
+  uint32_t outbox_sends;  // app messages sent to the phone
+  uint32_t outbox_bytes;  // their dictionary size
+  uint32_t vibes;         // vibe patterns started
+  uint32_t vibe_ms;       // motor on time
+  uint32_t wakeups;       // times the face was run, events at the same instant count once
+  uint32_t timers;        // app timers registered or rescheduled by the face
+  uint32_t persist_reads;
+  uint32_t persist_writes; // including deletes
+} HostCounters;
+
+typedef struct HostProcStats {
+  LayerUpdateProc proc;
+  const char *name;
+  uint32_t calls;
+  uint64_t ns_total;
+  uint64_t ns_min;
+  uint64_t ns_max;
+  HostCounters counters;  // work done inside this proc only
+} HostProcStats;
+
+extern HostCounters host_counters;
+extern bool host_verbose;
+
+void host_init(time_t start);
+void host_reset_counters(void);
+void host_name_proc(LayerUpdateProc proc, const char *name);
+const HostProcStats *host_proc_stats(int *count);
+
+// advance the virtual clock, delivering ticks, timers and animation frames,
+// and redrawing the window whenever something was marked dirty
+void host_advance(uint32_t ms);
+uint64_t host_now_ms(void);
+
+void host_set_battery(uint8_t charge_percent, bool is_charging, bool is_plugged);
+void host_set_connected(bool connected);
+void host_set_focus(bool in_focus);
+void host_tap(AccelAxisType axis, int32_t direction); // a wrist flick
+void host_set_moving(bool moving); // on the wrist, or lying still
+
+// deliver an app message from the phone to the inbox handler
+void host_receive_message(const Tuplet *tuplets, int count);
+
+// copy of the current screen contents, one GColor8 per pixel
+void host_read_screen(GColor8 *pixels);
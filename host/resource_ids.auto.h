@@ -0,0 +1,10 @@
+// Host copy of the resource ids the Pebble SDK generates from appinfo.json.
+// Keep in the same order as the "media" list there.
+
+#pragma once
+
+typedef enum {
+  RESOURCE_ID_IMAGE_MENU_ICON = 1,
+  RESOURCE_ID_IMAGE_ATLAS,
+  RESOURCE_ID_FONT_30,
+} ResourceId;
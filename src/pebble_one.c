@@ -22,6 +22,8 @@
 
 #include <pebble.h>
 #include <time.h>
+#include "geometry.auto.h" // generated from this file by tools/gen_geometry.py
+#include "atlas.auto.h"    // generated from resources/images by tools/gen_atlas.py
 
 // keys for app message and storage
 #define SECONDS_MODE   0
@@ -31,14 +33,39 @@
 #define GRAPHICS_MODE  4
 #define CONNLOST_MODE  5
 #define DATE_POS       6
+#define POWER_MODE     7
+#define NIGHT_MODE     8
+#define ALERT_MODE     11
+#define MOTION_MODE    12
+#define QUALITY_MODE   13
+#define TAP_SECONDS    14
+#define IDLE_MODE      15
+#define IDLE_MOTION    16
+#define SWEEP_MODE     17
+#define CONFIG_WIRE    10  // all of the above packed, see config_decode()
+#define CONFIG_WIRE_VERSION 1
+// fits the seven int32 settings that phones before 3.2 send,
+// newer settings only travel packed
 #define INBOX_SIZE     (1 + (7+4) * 7)
 
+#define TELEMETRY      9   // battery samples sent to the phone
+#define TELEMETRY_BATCH 10 // samples per message
 #define REQUEST_CONFIG 100
-#define OUTBOX_SIZE    (1 + (7+4) * 1)
+#define REQUEST_PROFILE 101 // from the phone, only handled if PROFILE
+#define OUTBOX_SIZE    (1 + (7+4) + 7 + 8 * TELEMETRY_BATCH) // a config request and a batch
+
+// keys for storage only
+#define DRAIN_STATE    200
+#define TELEMETRY_LOG  201
+#define CONFIG         202 // all settings, replaces the keys above since 3.2
+#define RESUME         203 // state at the last exit, see resume_read()
+#define CONFIG_VERSION 1
+#define CONFIG_WRITE_DELAY 2000 // ms after the last change
 
 #define SECONDS_MODE_NEVER    0
 #define SECONDS_MODE_IFNOTLOW 1
 #define SECONDS_MODE_ALWAYS   2
+#define SECONDS_MODE_TAP      3 // for TAP_SECONDS after a wrist flick
 #define BATTERY_MODE_NEVER    0
 #define BATTERY_MODE_IF_LOW   1
 #define BATTERY_MODE_ALWAYS   2
@@ -61,13 +88,52 @@
 #define GRAPHICS_MODE_INVERT  1
 #define CONNLOST_MODE_IGNORE  0
 #define CONNLOST_MODE_WARN    1
+#define POWER_MODE_OFF        0
+#define POWER_MODE_AUTO       1
+#define NIGHT_MODE_OFF        0
+#define NIGHT_MODE_22         1
+#define NIGHT_MODE_23         2
+#define NIGHT_MODE_0          3
+#define ALERT_MODE_SHORT      0
+#define ALERT_MODE_LONG       1
+#define ALERT_MODE_SILENT     2
+#define ALERT_MODE_BRIEF      3
+#define ALERT_MODE_COUNT      4
+#define MOTION_MODE_FULL      0
+#define MOTION_MODE_REDUCED   1
+#define QUALITY_MODE_AUTO     0 // high, low when the battery is low
+#define QUALITY_MODE_HIGH     1 // antialiased, outlined hands
+#define QUALITY_MODE_BALANCED 2 // no antialiasing for the second hand
+#define QUALITY_MODE_LOW      3 // plain lines for the hands, no antialiasing
+#define TAP_SECONDS_10        0
+#define TAP_SECONDS_30        1
+#define TAP_SECONDS_60        2
+#define IDLE_MODE_OFF         0 // else minute ticks after 15, 30 or 60 minutes lying still
+#define IDLE_MODE_15          1
+#define IDLE_MODE_30          2
+#define IDLE_MODE_60          3
+#define IDLE_MOTION_SLIGHT    0 // how much turning counts as picked up
+#define IDLE_MOTION_SOME      1
+#define IDLE_MOTION_STRONG    2
+#define SWEEP_MODE_OFF        0 // else 2, 4 or 8 frames per second
+#define SWEEP_MODE_2          1
+#define SWEEP_MODE_4          2
+#define SWEEP_MODE_8          3
+#define SWEEP_MIN_CHARGE      30 // percent, stepped seconds below unless plugged
 
+// power tiers picked by the governor, from most to least power
+#define POWER_TIER_FULL       0
+#define POWER_TIER_NO_SECONDS 1
+#define POWER_TIER_MINUTE     2 // also hides the battery icon
+#define POWER_TIER_ULTRA      3 // redraws every ULTRA_MINUTES only
+#define POWER_TIER_COUNT      4
+#define ULTRA_MINUTES         5
+#define POWER_HYSTERESIS      10 // percent above a threshold to step back up
+#define NIGHT_HOURS           8
 
-#define SCREENSHOT 0
-#define DEBUG      0
 
-#define ONE        TRIG_MAX_RATIO
-#define THREESIXTY TRIG_MAX_ANGLE
+#define SCREENSHOT 0
+#define PROFILE    0 // log callback timings and heap use, see profile_dump()
 
 #define EXTENT      PBL_IF_ROUND_ELSE(180, 144)
 #define CENTER_X    PBL_IF_ROUND_ELSE( 90, 71)
@@ -75,6 +141,8 @@
 #define DOTS_RADIUS PBL_IF_ROUND_ELSE( 80, 67)
 #define DOTS_SIZE   PBL_IF_ROUND_ELSE(  5,  4)
 #define SEC_RADIUS  PBL_IF_ROUND_ELSE( 72, 62)
+#define LOW_HOUR_WIDTH 11 // hand widths in QUALITY_MODE_LOW, odd as strokes are
+#define LOW_MIN_WIDTH   9
 
 #define max(a,b) ((a) > (b) ? (a) : (b))
 #define min(a,b) ((a) < (b) ? (a) : (b))
@@ -86,18 +154,37 @@ static int date_mode      = DATE_MODE_EN;
 static int bluetooth_mode = BLUETOOTH_MODE_ALWAYS;
 static int graphics_mode  = PBL_IF_ROUND_ELSE(GRAPHICS_MODE_INVERT, GRAPHICS_MODE_NORMAL);
 static int connlost_mode  = CONNLOST_MODE_WARN;
+static int power_mode     = POWER_MODE_OFF;
+static int night_mode     = NIGHT_MODE_OFF;
+static int alert_mode     = ALERT_MODE_SHORT;
+static int motion_mode    = MOTION_MODE_FULL;
+static int quality_mode   = QUALITY_MODE_AUTO;
+static int tap_seconds    = TAP_SECONDS_30;
+static int idle_mode      = IDLE_MODE_OFF;
+static int idle_motion    = IDLE_MOTION_SOME;
+static int sweep_mode     = SWEEP_MODE_OFF;
 static bool has_config = false;
 
 static Window *window;
 static Layer *background_layer;
 static Layer *hands_layer;
+static Layer *seconds_layer;
 static Layer *date_layer;
 static Layer *battery_layer;
 
+static GBitmap *atlas; // all images in one resource, cut into the sub-bitmaps below
 static GBitmap *logo;
-static BitmapLayer *logo_layer;
+static GRect logo_frame;
 
-static GBitmap *bluetooth_images[4];
+// the dial plate (dots and logo) is rendered once, then only the parts
+// with ink are blitted, everything else is window background anyway
+#define PLATE_RECTS 13
+static GBitmap *plate;
+static GRect plate_rects[PLATE_RECTS];
+static bool plate_valid = false;
+static bool started = false; // first frame drawn, see handle_deferred_init()
+
+static GBitmap *bluetooth_images[2]; // off and on
 static BitmapLayer *bluetooth_layer;
 
 static GColor bw_palette[2];
@@ -107,19 +194,135 @@ static GColor bw_palette[2];
 static struct tm *now = NULL;
 static int date_wday = -1;
 static int date_mday = -1;
-static bool hide_seconds = false;
+static GBitmap *date_cache; // date as last drawn, for date_wday and date_mday
+static GRect date_rects[2]; // inked part of date_cache, weekday and day of month
+static bool date_valid = false;
+static bool tap_subscribed = false;
+static bool accel_subscribed = false; // running for accel_service_peek() in idle_check()
+static time_t tap_until; // seconds shown until then in SECONDS_MODE_TAP, 0 if not
+static const uint8_t TAP_SECONDS_LENGTH[] = { 10, 30, 60 };
+// lying still: one accelerometer sample per minute tick, against the last
+static bool idle = false; // no seconds, only minute ticks, until moved
+static time_t still_since;
+static AccelData still_pose;
+static const uint8_t IDLE_MINUTES[] = { 0, 15, 30, 60 };
+static const uint16_t IDLE_MOTION_MG[] = { 50, 120, 300 }; // sum of the changes on the three axes
+static int tick_units = -1; // not subscribed yet, 0 while refreshed by timer
+static AppTimer *refresh_timer;
+static int power_tier = POWER_TIER_FULL;
+static int power_hour = -1; // hour of the last tier decision
 static bool was_connected = false;
+static bool resumed = false; // relaunched within RESUME_WINDOW of the last exit
+static int alert_blinks = 0; // blink phases left of the connection lost alert
+static AppTimer *alert_timer; // only while there are no second ticks to blink on
+
+static GFont font; // only loaded while the date is shown
+
+// what handle_layout() makes of the settings and the battery, applied field
+// by field so that only what changed touches the layers
+typedef struct {
+  uint8_t tick_units;  // 0 while refreshed by timer
+  uint8_t quality;     // QUALITY_MODE_HIGH to QUALITY_MODE_LOW
+  uint8_t font_mode;   // locale of the drawn date
+  uint8_t sweep_fps;   // 0 for stepped seconds
+  bool show_seconds;
+  bool show_battery;
+  bool show_date;
+  bool invert;
+  int16_t face_top;
+  int16_t date_top;
+  int16_t battery_top;
+} Face;
+#define FACE_TICKS   (1 << 0)
+#define FACE_QUALITY (1 << 1)
+#define FACE_FONT    (1 << 2)
+#define FACE_SECONDS (1 << 3)
+#define FACE_BATTERY (1 << 4)
+#define FACE_DATE    (1 << 5)
+#define FACE_COLORS  (1 << 6)
+#define FACE_FRAMES  (1 << 7)
+#define FACE_SWEEP   (1 << 8)
+#define FACE_ALL     0x1ff
+static Face face = { .quality = QUALITY_MODE_HIGH, .font_mode = DATE_MODE_OFF };
+static bool face_applied = false; // nothing is until the first layout
 
-static GFont font;
 #define DATE_BUFFER_BYTES 32
 static char date_buffer[DATE_BUFFER_BYTES];
 
-#if DEBUG
-static TextLayer *debug_layer;
-#define DEBUG_BUFFER_BYTES 32
-static char debug_buffer[DEBUG_BUFFER_BYTES];
+#if PROFILE
+// wall time spent in each callback, in milliseconds as that is what time_ms()
+// resolves, so the average is only meaningful over many calls
+#define PROFILE_BUCKETS 8 // 0, 1, 2-3, 4-7, ... 64+ ms
+enum {
+  PROBE_BACKGROUND, PROBE_HANDS, PROBE_SECONDS, PROBE_DATE, PROBE_BATTERY,
+  PROBE_TICK, PROBE_LAYOUT, PROBE_RECEIVE, PROBE_COUNT
+};
+static struct {
+  const char *name;
+  uint32_t count;
+  uint32_t total_ms;
+  uint16_t min_ms;
+  uint16_t max_ms;
+  uint16_t histogram[PROFILE_BUCKETS];
+} probes[PROBE_COUNT] = {
+  { "background" }, { "hands" }, { "seconds" }, { "date" }, { "battery" },
+  { "tick" }, { "layout" }, { "receive" },
+};
+
+uint32_t profile_now() {
+  time_t seconds;
+  uint16_t ms = time_ms(&seconds, NULL);
+  return seconds * 1000 + ms;
+}
+
+void profile_record(int probe, uint32_t start) {
+  uint32_t ms = profile_now() - start;
+  int bucket = 0;
+  while (bucket < PROFILE_BUCKETS - 1 && ms >= (1u << bucket))
+    bucket++;
+  probes[probe].min_ms = probes[probe].count ? min(probes[probe].min_ms, ms) : ms;
+  probes[probe].max_ms = max(probes[probe].max_ms, ms);
+  probes[probe].total_ms += ms;
+  probes[probe].count++;
+  probes[probe].histogram[bucket]++;
+}
+
+// heap use after each allocation phase; the peak is over these samples only,
+// which is where it grows as nothing allocates while drawing
+static size_t heap_peak;
+
+void profile_heap(const char *phase) {
+  size_t used = heap_bytes_used();
+  heap_peak = max(heap_peak, used);
+  APP_LOG(APP_LOG_LEVEL_INFO, "heap after %s: %d used, %d free, peak %d",
+    phase, (int) used, (int) heap_bytes_free(), (int) heap_peak);
+}
+
+void profile_dump() {
+  for (int i = 0; i < PROBE_COUNT; i++) {
+    if (!probes[i].count) continue;
+    uint16_t *h = probes[i].histogram;
+    APP_LOG(APP_LOG_LEVEL_INFO, "%s: %d calls, min %d avg %d.%02d max %d ms, histogram %d %d %d %d %d %d %d %d",
+      probes[i].name, (int) probes[i].count, probes[i].min_ms,
+      (int) (probes[i].total_ms / probes[i].count), (int) (probes[i].total_ms * 100 / probes[i].count % 100),
+      probes[i].max_ms, h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "heap: %d used, %d free, peak %d",
+    (int) heap_bytes_used(), (int) heap_bytes_free(), (int) heap_peak);
+}
+
+static uint32_t init_ms; // for the time to the first frame
+
+#define PROFILE_BEGIN() uint32_t profile_start = profile_now()
+#define PROFILE_END(probe) profile_record(probe, profile_start)
+#define PROFILE_HEAP(phase) profile_heap(phase)
+#else
+#define PROFILE_BEGIN()
+#define PROFILE_END(probe)
+#define PROFILE_HEAP(phase)
 #endif
 
+// hand shapes, pre-rotated at build time into the tables in geometry.auto.h
 const GPathInfo HOUR_POINTS = {
   6,
   (GPoint []) {
@@ -131,6 +334,7 @@ const GPathInfo HOUR_POINTS = {
     { 6,  0},
   }
 };
+static GPoint hour_points[HOUR_POINT_COUNT];
 static GPath *hour_path;
 
 const GPathInfo MIN_POINTS = {
@@ -144,6 +348,7 @@ const GPathInfo MIN_POINTS = {
     { 5,  0},
   }
 };
+static GPoint min_points[MIN_POINT_COUNT];
 static GPath *min_path;
 
 const GPathInfo SEC_POINTS = {
@@ -155,6 +360,7 @@ const GPathInfo SEC_POINTS = {
     {-2,  0},
   }
 };
+static GPoint sec_points[SEC_POINT_COUNT];
 static GPath *sec_path;
 
 const GPathInfo BATTERY_POINTS = {
@@ -192,105 +398,285 @@ const char WEEKDAY_NAMES[6][7][5] = { // 3 chars, 1 for utf-8, 1 for terminating
   {"Sön", "Mån", "Tis", "Ons", "Tor", "Fre", "Lör"},
 };
 
+// startup animation, keyframes precomputed by startup_animation_init()
+#define STARTUP_DURATION   250 // ms
+#define STARTUP_FRAMES     8   // redraws at most, whatever the animation rate
+#define STARTUP_MIN_CHARGE 20  // percent, skip the animation below unless plugged
+
+typedef struct {
+  int8_t dots[12][2];  // from the center
+  int8_t hands[3][2];  // hour, minute, second, from the center
+  uint8_t dots_radius;
+} StartupFrame;
+
 static Animation *startup_animation;
-static int32_t hour_angle = 0;
-static int32_t min_angle = 0;
-static int32_t sec_angle = 0;
-static GPoint hour_pos, hour_delta;
-static GPoint min_pos, min_delta;
-static GPoint sec_pos, sec_delta;
+static StartupFrame *startup_frames; // STARTUP_FRAMES + 1, the last one final
+static int startup_frame = -1;
+static int hour_step = 0; // 0-59 around the dial
+static int min_step = 0;
+static int sec_step = 0;
+static int32_t sec_angle = 0; // sub-second, while the second hand sweeps
+static int hour_path_step = -1;
+static int min_path_step = -1;
+static GPoint hour_pos, min_pos, sec_pos;
 static int32_t dots_radius = 0;
 
-void background_layer_update_callback(Layer *layer, GContext* ctx) {
-  if (!dots_radius) return;
-  graphics_context_set_fill_color(ctx, FG_COLOR);
-  for (int32_t angle = 0; angle < THREESIXTY; angle += THREESIXTY / 12) {
-    GPoint pos = GPoint(
-      CENTER_X + dots_radius * cos_lookup(angle) / ONE,
-      CENTER_Y - dots_radius * sin_lookup(angle) / ONE);
-    graphics_fill_circle(ctx, pos, DOTS_SIZE);
+// a point from a first-quadrant table in geometry.auto.h, rotated to step
+GPoint table_point(const int8_t *table, int count, int index, int step) {
+  const int8_t *p = table + ((step % GEOMETRY_QUADRANT) * count + index) * 2;
+  GPoint point = GPoint(p[0], p[1]);
+  for (int quadrant = step / GEOMETRY_QUADRANT; quadrant > 0; quadrant--)
+    point = GPoint(-point.y, point.x);
+  return point;
+}
+
+void rotate_points(GPoint *points, const int8_t *table, int count, int step) {
+  for (int i = 0; i < count; i++)
+    points[i] = table_point(table, count, i, step);
+}
+
+// where a hand at step starts from in the startup animation
+GPoint hand_start(int step) {
+  return table_point(&HAND_START_TABLE[0][0], 1, 0, step);
+}
+
+// redraw the dial and the date from scratch, e.g. after the colors changed
+void invalidate_caches() {
+  plate_valid = false;
+  date_valid = false;
+  layer_mark_dirty(background_layer);
+  layer_mark_dirty(date_layer);
+}
+
+// two color offscreen copy of a layer, filled by capture_layer()
+GBitmap *create_cache(GSize size) {
+#ifdef PBL_BW
+  return gbitmap_create_blank(size, GBitmapFormat1Bit);
+#else
+  return gbitmap_create_blank_with_palette(size, GBitmapFormat1BitPalette, bw_palette, false);
+#endif
+}
+
+// copy what a layer of the window just drew from the frame buffer into its
+// cache, which keeps only the foreground, so the layer must draw without
+// antialiasing for the copy to look the same
+bool capture_layer(Layer *layer, GContext* ctx, GBitmap *cache) {
+  GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+  if (!frame_buffer) return false;
+  GRect frame = layer_get_frame(layer);
+  int top = frame.origin.y;
+  int rows = min(frame.size.h, gbitmap_get_bounds(frame_buffer).size.h - top);
+  uint8_t *cache_data = gbitmap_get_data(cache);
+  uint16_t cache_row_bytes = gbitmap_get_bytes_per_row(cache);
+  for (int y = 0; y < rows; y++) {
+    uint8_t *cache_row = cache_data + y * cache_row_bytes;
+#ifdef PBL_BW
+    // same 1-bit format, copy whole rows
+    memcpy(cache_row,
+      gbitmap_get_data(frame_buffer) + (top + y) * gbitmap_get_bytes_per_row(frame_buffer),
+      min(cache_row_bytes, gbitmap_get_bytes_per_row(frame_buffer)));
+#else
+    // reduce to palette indices, the cache only has background and foreground
+    GBitmapDataRowInfo row = gbitmap_get_data_row_info(frame_buffer, top + y);
+    memset(cache_row, 0, cache_row_bytes);
+    for (int x = row.min_x; x <= row.max_x && x < frame.size.w; x++)
+      if (row.data[x] == FG_COLOR.argb)
+        cache_row[x / 8] |= 0x80 >> (x % 8);
+#endif
   }
+  graphics_release_frame_buffer(ctx, frame_buffer);
+  return true;
 }
 
-void update_angles() {
-  hour_angle = THREESIXTY * (now->tm_hour * 5 + now->tm_min / 12) / 60;
-  min_angle = THREESIXTY * now->tm_min / 60;
-  sec_angle = THREESIXTY * now->tm_sec / 60;
+void handle_deferred_init(void *data);
+
+void background_layer_update_callback(Layer *layer, GContext* ctx) {
+  PROFILE_BEGIN();
+  if (!started) {
+    started = true;
+#if PROFILE
+    APP_LOG(APP_LOG_LEVEL_INFO, "First frame %d ms after init", (int) (profile_now() - init_ms));
+#endif
+    app_timer_register(0, handle_deferred_init, NULL);
+  }
+  if (plate_valid) {
+    for (int i = 0; i < PLATE_RECTS; i++) {
+      gbitmap_set_bounds(plate, plate_rects[i]);
+      graphics_draw_bitmap_in_rect(ctx, plate, plate_rects[i]);
+    }
+    PROFILE_END(PROBE_BACKGROUND);
+    return;
+  }
+  graphics_context_set_antialiased(ctx, false); // see capture_layer()
+  if (dots_radius) {
+    graphics_context_set_fill_color(ctx, FG_COLOR);
+    const int8_t (*dots)[2] = startup_frames ? startup_frames[startup_frame].dots : DOT_CENTERS;
+    for (int i = 0; i < 12; i++)
+      graphics_fill_circle(ctx, GPoint(CENTER_X + dots[i][0], CENTER_Y + dots[i][1]), DOTS_SIZE);
+  }
+  graphics_draw_bitmap_in_rect(ctx, logo, logo_frame);
+  // only cache the final state, not the startup animation
+  if (dots_radius == DOTS_RADIUS) {
+    if (!plate) plate = create_cache(GSize(EXTENT, EXTENT));
+    plate_valid = plate && capture_layer(layer, ctx, plate);
+  }
+  PROFILE_END(PROBE_BACKGROUND);
 }
 
-void hands_layer_update_callback(Layer *layer, GContext* ctx) {
+void update_steps() {
 #if SCREENSHOT
   now->tm_hour = 10;
   now->tm_min = 9;
   now->tm_sec = 36;
 #endif
-  update_angles();
-  
-  // hours and minutes
-  gpath_rotate_to(hour_path, hour_angle);
-  gpath_rotate_to(min_path, min_angle);
+  hour_step = (now->tm_hour * 5 + now->tm_min / 12) % GEOMETRY_STEPS;
+  min_step = now->tm_min;
+  sec_step = now->tm_sec;
+}
+
+// the sweeping second hand is rotated at runtime, the tables only have whole seconds
+GPoint sweep_rotate(GPoint point) {
+  int32_t c = cos_lookup(sec_angle), s = sin_lookup(sec_angle);
+  return GPoint((point.x * c - point.y * s) / TRIG_MAX_RATIO, (point.x * s + point.y * c) / TRIG_MAX_RATIO);
+}
+
+GPoint sec_end() {
+  GPoint end = face.sweep_fps ? sweep_rotate(GPoint(0, -SEC_RADIUS))
+    : table_point(&SEC_END_TABLE[0][0], 1, 0, sec_step);
+  return GPoint(sec_pos.x + end.x, sec_pos.y + end.y);
+}
+
+// the seconds layer only covers the hand and the center dot on top of it
+void update_seconds_frame() {
+  GPoint end = sec_end();
+  int margin = DOTS_SIZE + 1;
+  int left   = min(min(sec_pos.x, end.x), min_pos.x) - margin;
+  int top    = min(min(sec_pos.y, end.y), min_pos.y) - margin;
+  int right  = max(max(sec_pos.x, end.x), min_pos.x) + margin;
+  int bottom = max(max(sec_pos.y, end.y), min_pos.y) + margin;
+  GRect frame = GRect(left, top, right - left + 1, bottom - top + 1);
+  layer_set_frame(seconds_layer, frame);
+  // draw in the same coordinates as the hands layer
+  layer_set_bounds(seconds_layer, GRect(-left, -top, frame.size.w, frame.size.h));
+}
+
+// middle of the tip of a rotated hand, points 1 and 2 in the shapes above
+GPoint hand_tip(const GPoint *points, GPoint pos) {
+  return GPoint(pos.x + (points[1].x + points[2].x) / 2, pos.y + (points[1].y + points[2].y) / 2);
+}
+
+void hands_layer_update_callback(Layer *layer, GContext* ctx) {
+  PROFILE_BEGIN();
+  // hours and minutes, rotated only when they moved
+  if (hour_path_step != hour_step) {
+    rotate_points(hour_points, &HOUR_TABLE[0][0][0], HOUR_POINT_COUNT, hour_step);
+    hour_path_step = hour_step;
+  }
+  if (min_path_step != min_step) {
+    rotate_points(min_points, &MIN_TABLE[0][0][0], MIN_POINT_COUNT, min_step);
+    min_path_step = min_step;
+  }
+  graphics_context_set_antialiased(ctx, face.quality != QUALITY_MODE_LOW);
   graphics_context_set_fill_color(ctx, FG_COLOR);
-  graphics_context_set_stroke_color(ctx, BG_COLOR);
-  gpath_draw_filled(ctx, hour_path);
-  gpath_draw_outline(ctx, hour_path);
-  graphics_fill_circle(ctx, hour_pos, DOTS_SIZE+3);
-  gpath_draw_filled(ctx, min_path);
-  gpath_draw_outline(ctx, min_path);
-  graphics_fill_circle(ctx, min_pos, DOTS_SIZE+3);
-
-  // seconds
-  if (!hide_seconds) {
-    GPoint sec_end = GPoint(
-      sec_pos.x + SEC_RADIUS * sin_lookup(sec_angle) / ONE,
-      sec_pos.y - SEC_RADIUS * cos_lookup(sec_angle) / ONE);
-    graphics_context_set_fill_color(ctx, BG_COLOR);
-    gpath_rotate_to(sec_path, sec_angle);
-    gpath_draw_filled(ctx, sec_path);
+  if (face.quality == QUALITY_MODE_LOW) {
+    // thick lines to the middle of the tips, no outlines
     graphics_context_set_stroke_color(ctx, FG_COLOR);
-    graphics_context_set_compositing_mode(ctx, GCompOpAssignInverted);
-    graphics_draw_line(ctx, sec_pos, sec_end);
+    graphics_context_set_stroke_width(ctx, LOW_HOUR_WIDTH);
+    graphics_draw_line(ctx, hour_pos, hand_tip(hour_points, hour_pos));
+    graphics_context_set_stroke_width(ctx, LOW_MIN_WIDTH);
+    graphics_draw_line(ctx, min_pos, hand_tip(min_points, min_pos));
+    graphics_context_set_stroke_width(ctx, 1);
+    graphics_fill_circle(ctx, min_pos, DOTS_SIZE+3);
+  } else {
+    graphics_context_set_stroke_color(ctx, BG_COLOR);
+    gpath_draw_filled(ctx, hour_path);
+    gpath_draw_outline(ctx, hour_path);
+    graphics_fill_circle(ctx, hour_pos, DOTS_SIZE+3);
+    gpath_draw_filled(ctx, min_path);
+    gpath_draw_outline(ctx, min_path);
+    graphics_fill_circle(ctx, min_pos, DOTS_SIZE+3);
   }
 
   // center dot
   graphics_context_set_fill_color(ctx, BG_COLOR);
   graphics_fill_circle(ctx, min_pos, DOTS_SIZE);
+  PROFILE_END(PROBE_HANDS);
+}
+
+void seconds_layer_update_callback(Layer *layer, GContext* ctx) {
+  PROFILE_BEGIN();
+  graphics_context_set_antialiased(ctx, face.quality == QUALITY_MODE_HIGH);
+  graphics_context_set_fill_color(ctx, BG_COLOR);
+  if (face.quality != QUALITY_MODE_LOW) { // the background colored border of the hand
+    if (face.sweep_fps) {
+      for (int i = 0; i < SEC_POINT_COUNT; i++)
+        sec_points[i] = sweep_rotate(SEC_POINTS.points[i]);
+    } else {
+      rotate_points(sec_points, &SEC_TABLE[0][0][0], SEC_POINT_COUNT, sec_step);
+    }
+    gpath_draw_filled(ctx, sec_path);
+  }
+  graphics_context_set_stroke_color(ctx, FG_COLOR);
+  graphics_context_set_compositing_mode(ctx, GCompOpAssignInverted);
+  graphics_draw_line(ctx, sec_pos, sec_end());
+
+  // center dot
+  graphics_fill_circle(ctx, min_pos, DOTS_SIZE);
+  PROFILE_END(PROBE_SECONDS);
 }
 
+// the text only changes once a day, so it is drawn once and then copied
 void date_layer_update_callback(Layer *layer, GContext* ctx) {
+  PROFILE_BEGIN();
 
 #if SCREENSHOT
   now->tm_wday = 0;
   now->tm_mday = 25;
 #endif
 
+  if (date_valid && now->tm_wday == date_wday && now->tm_mday == date_mday) {
+    for (int i = 0; i < 2; i++) {
+      gbitmap_set_bounds(date_cache, date_rects[i]);
+      graphics_draw_bitmap_in_rect(ctx, date_cache, date_rects[i]);
+    }
+    PROFILE_END(PROBE_DATE);
+    return;
+  }
+
+  graphics_context_set_antialiased(ctx, false); // see capture_layer()
   graphics_context_set_text_color(ctx, FG_COLOR);
+  GRect box = GRect(0, -6, EXTENT, 32);
 
   // weekday
-  if (date_mode < DATE_MODE_FIRST || date_mode > DATE_MODE_LAST)
-    date_mode = DATE_MODE_FIRST;
-  graphics_draw_text(ctx,
-    WEEKDAY_NAMES[date_mode - DATE_MODE_FIRST][now->tm_wday],
-    font,
-    GRect(0, -6, EXTENT, 32),
+  const char *weekday = WEEKDAY_NAMES[date_mode - DATE_MODE_FIRST][now->tm_wday];
+  graphics_draw_text(ctx, weekday, font, box,
     GTextOverflowModeWordWrap,
     GTextAlignmentLeft,
     NULL);
+  GSize size = graphics_text_layout_get_content_size(weekday, font, box,
+    GTextOverflowModeWordWrap, GTextAlignmentLeft);
+  date_rects[0] = GRect(0, 0, min(size.w + 2, EXTENT), 24);
 
   // day of month
   strftime(date_buffer, DATE_BUFFER_BYTES, "%e", now);
-  graphics_draw_text(ctx,
-    date_buffer,
-    font,
-    GRect(0, -6, EXTENT, 32),
+  graphics_draw_text(ctx, date_buffer, font, box,
     GTextOverflowModeWordWrap,
     GTextAlignmentRight,
     NULL);
+  size = graphics_text_layout_get_content_size(date_buffer, font, box,
+    GTextOverflowModeWordWrap, GTextAlignmentRight);
+  size.w = min(size.w + 2, EXTENT);
+  date_rects[1] = GRect(EXTENT - size.w, 0, size.w, 24);
 
   date_wday = now->tm_wday;
   date_mday = now->tm_mday;
+  if (!date_cache) date_cache = create_cache(GSize(EXTENT, 24));
+  date_valid = date_cache && capture_layer(layer, ctx, date_cache);
+  PROFILE_END(PROBE_DATE);
 }
 
 void battery_layer_update_callback(Layer *layer, GContext* ctx) {
+  PROFILE_BEGIN();
   BatteryChargeState battery = battery_state_service_peek();
   graphics_context_set_stroke_color(ctx, FG_COLOR);
   gpath_draw_outline(ctx, battery_path);
@@ -303,14 +689,69 @@ void battery_layer_update_callback(Layer *layer, GContext* ctx) {
   graphics_fill_rect(ctx, GRect(9, 2, width, 5), 0, GCornerNone);  
   if (battery.is_plugged)
     gpath_draw_outline_open(ctx, charge_path);
+  PROFILE_END(PROBE_BATTERY);
 }
 
-void handle_tick(struct tm *tick_time, TimeUnits units_changed) {
+void handle_layout();
+void alert_blink();
+
+// seconds again, from a tap, a bluetooth event or motion
+void idle_wake() {
+  if (!idle) return;
+  idle = false;
   time_t clock = time(NULL);
+  still_since = clock;
   now = localtime(&clock);
+  update_steps();
+  handle_layout();
   layer_mark_dirty(hands_layer);
+  if (face.show_seconds) {
+    update_seconds_frame();
+    layer_mark_dirty(seconds_layer);
+  }
+  if (date_pos != DATE_POS_OFF && (now->tm_wday != date_wday || now->tm_mday != date_mday))
+    layer_mark_dirty(date_layer);
+}
+
+void idle_check(time_t clock) {
+  AccelData pose;
+  if (accel_service_peek(&pose) < 0 || pose.did_vibrate) return;
+  int motion = abs(pose.x - still_pose.x) + abs(pose.y - still_pose.y) + abs(pose.z - still_pose.z);
+  still_pose = pose;
+  if (!still_since || motion > IDLE_MOTION_MG[min(idle_motion, IDLE_MOTION_STRONG)]) {
+    still_since = clock;
+    idle_wake();
+  } else if (!idle && clock - still_since >= IDLE_MINUTES[min(idle_mode, IDLE_MODE_60)] * 60) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Idle after %d minutes still", (int) (clock - still_since) / 60);
+    idle = true;
+    handle_layout(); // no seconds, and taps to wake
+  }
+}
+
+void handle_tick(struct tm *tick_time, TimeUnits units_changed) {
+  PROFILE_BEGIN();
+  time_t clock = time(NULL);
+  now = localtime(&clock);
+  update_steps();
+  if (idle_mode != IDLE_MODE_OFF && (units_changed & MINUTE_UNIT))
+    idle_check(clock);
+  if (units_changed & MINUTE_UNIT)
+    layer_mark_dirty(hands_layer); // also while idle, it costs no extra wakeup
+  if (tap_until && clock >= tap_until) {
+    tap_until = 0;
+    handle_layout(); // back to minute ticks
+  }
+  if (face.show_seconds && !face.sweep_fps) {
+    update_seconds_frame();
+    layer_mark_dirty(seconds_layer);
+  }
+  if (alert_blinks && tick_units == SECOND_UNIT)
+    alert_blink();
   if (date_pos != DATE_POS_OFF && (now->tm_wday != date_wday || now->tm_mday != date_mday))
     layer_mark_dirty(date_layer);
+  if (now->tm_hour != power_hour && (power_mode == POWER_MODE_AUTO || night_mode != NIGHT_MODE_OFF))
+    handle_layout(); // the night window may have started or ended
+  PROFILE_END(PROBE_TICK);
 }
 
 void handle_app_did_focus(bool in_focus) {
@@ -320,43 +761,42 @@ void handle_app_did_focus(bool in_focus) {
   }
 }
 
-void startup_animation_init() {
-  update_angles();
-  hour_delta = GPoint(
-    DOTS_RADIUS * sin_lookup(hour_angle) / ONE,
-    -DOTS_RADIUS * cos_lookup(hour_angle) / ONE);
-  gpath_move_to(hour_path, GPoint(CENTER_X + hour_delta.x, CENTER_Y + hour_delta.y));
-  min_delta = GPoint(
-    DOTS_RADIUS * sin_lookup(min_angle) / ONE,
-    -DOTS_RADIUS * cos_lookup(min_angle) / ONE);
-  gpath_move_to(min_path, GPoint(CENTER_X + min_delta.x, CENTER_Y + min_delta.y));
-  sec_delta = GPoint(
-    DOTS_RADIUS * sin_lookup(sec_angle) / ONE,
-    -DOTS_RADIUS * cos_lookup(sec_angle) / ONE);
-  gpath_move_to(sec_path, GPoint(CENTER_X + sec_delta.x, CENTER_Y + sec_delta.y));
+GPoint startup_hand_pos(int hand) {
+  const int8_t *delta = startup_frames[startup_frame].hands[hand];
+  return GPoint(CENTER_X + delta[0], CENTER_Y + delta[1]);
 }
 
-void startup_animation_update(Animation *animation, const AnimationProgress progress) {
-  dots_radius = DOTS_RADIUS * progress / ANIMATION_NORMALIZED_MAX;
-  AnimationProgress reverse = ANIMATION_NORMALIZED_MAX - progress;
-  hour_pos = GPoint(
-    CENTER_X + hour_delta.x * reverse / ANIMATION_NORMALIZED_MAX, 
-    CENTER_Y + hour_delta.y * reverse / ANIMATION_NORMALIZED_MAX);
+// only what moved since the last keyframe is marked dirty
+void startup_show_frame(int frame) {
+  int old_radius = dots_radius;
+  startup_frame = frame;
+  dots_radius = startup_frames[frame].dots_radius;
+  if (dots_radius != old_radius)
+    layer_mark_dirty(background_layer);
+  GPoint pos[3] = { startup_hand_pos(0), startup_hand_pos(1), startup_hand_pos(2) };
+  if (gpoint_equal(&pos[0], &hour_pos) && gpoint_equal(&pos[1], &min_pos) && gpoint_equal(&pos[2], &sec_pos))
+    return;
+  hour_pos = pos[0];
   gpath_move_to(hour_path, hour_pos);
-  min_pos = GPoint(
-    CENTER_X + min_delta.x * reverse / ANIMATION_NORMALIZED_MAX, 
-    CENTER_Y + min_delta.y * reverse / ANIMATION_NORMALIZED_MAX);
+  min_pos = pos[1];
   gpath_move_to(min_path, min_pos);
-  sec_pos = GPoint(
-    CENTER_X + sec_delta.x * reverse / ANIMATION_NORMALIZED_MAX, 
-    CENTER_Y + sec_delta.y * reverse / ANIMATION_NORMALIZED_MAX);
+  sec_pos = pos[2];
   gpath_move_to(sec_path, sec_pos);
-  layer_mark_dirty(background_layer);
+  update_seconds_frame();
   layer_mark_dirty(hands_layer);
+  layer_mark_dirty(seconds_layer);
+}
+
+void startup_animation_update(Animation *animation, const AnimationProgress progress) {
+  int frame = progress * STARTUP_FRAMES / ANIMATION_NORMALIZED_MAX;
+  if (frame != startup_frame)
+    startup_show_frame(frame);
 }
 
 void startup_animation_teardown(Animation *animation) {
-  startup_animation_update(animation, ANIMATION_NORMALIZED_MAX);
+  startup_show_frame(STARTUP_FRAMES);
+  free(startup_frames);
+  startup_frames = NULL;
   animation_destroy(animation);
 }
 
@@ -365,115 +805,798 @@ static AnimationImplementation startup_animation_implementation = {
   .teardown = startup_animation_teardown
 };
 
-void lost_connection_warning(void *);
+// straight to the final state, hands centered and all dots out
+void startup_skip() {
+  dots_radius = DOTS_RADIUS;
+  hour_pos = min_pos = sec_pos = GPoint(CENTER_X, CENTER_Y);
+  update_seconds_frame();
+}
+
+// the animation flies the hands in from the edge and grows the dots,
+// unless the battery is low or motion is reduced in the settings
+void startup_animation_init() {
+  update_steps();
+  BatteryChargeState battery = battery_state_service_peek();
+  if (resumed || motion_mode == MOTION_MODE_REDUCED ||
+      (battery.charge_percent <= STARTUP_MIN_CHARGE && !battery.is_plugged)) {
+    startup_skip();
+    return;
+  }
+  startup_frames = malloc((STARTUP_FRAMES + 1) * sizeof(StartupFrame));
+  if (!startup_frames) {
+    startup_skip();
+    return;
+  }
+  GPoint start[3] = { hand_start(hour_step), hand_start(min_step), hand_start(sec_step) };
+  // evenly spaced in eased progress, the curve is applied by the animation
+  for (int frame = 0; frame <= STARTUP_FRAMES; frame++) {
+    int32_t progress = ANIMATION_NORMALIZED_MAX * frame / STARTUP_FRAMES;
+    int32_t reverse = ANIMATION_NORMALIZED_MAX - progress;
+    StartupFrame *keyframe = &startup_frames[frame];
+    keyframe->dots_radius = DOTS_RADIUS * progress / ANIMATION_NORMALIZED_MAX;
+    for (int i = 0; i < 12; i++) {
+      keyframe->dots[i][0] = DOT_CENTERS[i][0] * progress / ANIMATION_NORMALIZED_MAX;
+      keyframe->dots[i][1] = DOT_CENTERS[i][1] * progress / ANIMATION_NORMALIZED_MAX;
+    }
+    for (int hand = 0; hand < 3; hand++) {
+      keyframe->hands[hand][0] = start[hand].x * reverse / ANIMATION_NORMALIZED_MAX;
+      keyframe->hands[hand][1] = start[hand].y * reverse / ANIMATION_NORMALIZED_MAX;
+    }
+  }
+  // hands at their start, no dots yet, until the window is in focus
+  startup_show_frame(0);
+  startup_animation = animation_create();
+  animation_set_duration(startup_animation, STARTUP_DURATION);
+  animation_set_curve(startup_animation, AnimationCurveEaseOut);
+  animation_set_implementation(startup_animation, &startup_animation_implementation);
+}
+
+// battery samples kept for the phone, see store_telemetry() in pebble_one.js
+#define TELEMETRY_SAMPLES  30 // fits into one persist key
+#define TELEMETRY_PLUGGED  1
+#define TELEMETRY_CHARGING 2
+
+typedef struct {
+  int32_t time;
+  uint8_t charge;   // percent
+  uint8_t flags;    // TELEMETRY_PLUGGED, TELEMETRY_CHARGING
+  uint8_t config;   // see telemetry_config()
+  uint8_t reserved;
+} TelemetrySample;
+
+static struct {
+  uint8_t head;     // next slot to write
+  uint8_t count;    // samples stored
+  uint8_t unsent;   // newest samples not yet delivered to the phone
+  uint8_t reserved;
+  TelemetrySample samples[TELEMETRY_SAMPLES];
+} telemetry;
+static int telemetry_in_flight = 0; // samples in the outbox
+static bool telemetry_loaded = false; // read from storage by handle_deferred_init()
+
+uint8_t telemetry_config() {
+  return seconds_mode | graphics_mode << 2 | date_pos << 3 | power_tier << 5;
+}
+
+// messages to the phone: one in flight at a time, carrying everything that
+// is pending, so repeated requests coalesce. Failed sends are retried with
+// backoff, or right away on reconnect, see handle_bluetooth().
+#define OUTBOX_RETRY_MS     1000  // first retry, doubled after each failure
+#define OUTBOX_RETRY_MAX_MS 64000
+
+static bool config_requested = false;  // waiting to be sent
+static bool config_asked = false;      // the phone acked a request, in this or a resumed launch
+static bool config_request_in_flight = false;
+static bool outbox_busy = false;       // until the phone acks or the send fails
+static AppTimer *outbox_retry_timer;
+static uint32_t outbox_retry_ms = OUTBOX_RETRY_MS;
+
+void outbox_send() {
+  int count = min(telemetry.unsent, TELEMETRY_BATCH);
+  if (outbox_busy || outbox_retry_timer || (!config_requested && !count) ||
+      !bluetooth_connection_service_peek())
+    return;
+  DictionaryIterator *iter;
+  if (app_message_outbox_begin(&iter) != APP_MSG_OK) return;
+  if (config_requested)
+    dict_write_int32(iter, REQUEST_CONFIG, 1);
+  if (count) {
+    // oldest unsent first, unwrapped from the ring
+    TelemetrySample batch[TELEMETRY_BATCH];
+    int first = telemetry.head + TELEMETRY_SAMPLES - telemetry.unsent;
+    for (int i = 0; i < count; i++)
+      batch[i] = telemetry.samples[(first + i) % TELEMETRY_SAMPLES];
+    dict_write_data(iter, TELEMETRY, (uint8_t *) batch, count * sizeof(TelemetrySample));
+  }
+  dict_write_end(iter);
+  if (app_message_outbox_send() != APP_MSG_OK) return;
+  outbox_busy = true;
+  config_request_in_flight = config_requested;
+  config_requested = false;
+  telemetry_in_flight = count;
+}
+
+void handle_outbox_retry(void *data) {
+  outbox_retry_timer = NULL;
+  outbox_send();
+}
+
+// after a reconnect, don't wait for the backoff
+void outbox_resume() {
+  if (outbox_retry_timer) {
+    app_timer_cancel(outbox_retry_timer);
+    outbox_retry_timer = NULL;
+  }
+  outbox_retry_ms = OUTBOX_RETRY_MS;
+  outbox_send();
+}
+
+void telemetry_record(BatteryChargeState charge_state) {
+  if (!telemetry_loaded) return; // would write the empty ring over the stored one
+  TelemetrySample sample = {
+    .time = time(NULL),
+    .charge = charge_state.charge_percent,
+    .flags = (charge_state.is_plugged ? TELEMETRY_PLUGGED : 0) | (charge_state.is_charging ? TELEMETRY_CHARGING : 0),
+    .config = telemetry_config(),
+  };
+  if (telemetry.count) {
+    TelemetrySample *last = &telemetry.samples[(telemetry.head + TELEMETRY_SAMPLES - 1) % TELEMETRY_SAMPLES];
+    if (last->charge == sample.charge && last->flags == sample.flags && last->config == sample.config)
+      return;
+  }
+  telemetry.samples[telemetry.head] = sample;
+  telemetry.head = (telemetry.head + 1) % TELEMETRY_SAMPLES;
+  telemetry.count = min(telemetry.count + 1, TELEMETRY_SAMPLES);
+  telemetry.unsent = min(telemetry.unsent + 1, TELEMETRY_SAMPLES);
+  persist_write_data(TELEMETRY_LOG, &telemetry, sizeof(telemetry));
+  outbox_send();
+}
+
+void handle_outbox_sent(DictionaryIterator *sent, void *context) {
+  outbox_busy = false;
+  outbox_retry_ms = OUTBOX_RETRY_MS;
+  config_asked |= config_request_in_flight;
+  config_request_in_flight = false;
+  if (telemetry_in_flight) {
+    telemetry.unsent -= min(telemetry_in_flight, telemetry.unsent);
+    telemetry_in_flight = 0;
+    persist_write_data(TELEMETRY_LOG, &telemetry, sizeof(telemetry));
+  }
+  outbox_send();
+}
+
+void handle_outbox_failed(DictionaryIterator *failed, AppMessageResult reason, void *context) {
+  // keep what was in flight for the retry, the samples are still unsent
+  outbox_busy = false;
+  config_requested |= config_request_in_flight;
+  config_request_in_flight = false;
+  telemetry_in_flight = 0;
+  if (!bluetooth_connection_service_peek() || outbox_retry_timer)
+    return; // the reconnect resumes
+  outbox_retry_timer = app_timer_register(outbox_retry_ms, handle_outbox_retry, NULL);
+  outbox_retry_ms = min(2 * outbox_retry_ms, OUTBOX_RETRY_MAX_MS);
+}
+
+// connection lost alert: one vibe pattern up front, then the icon blinks
+// once a second, on the second tick if there is one, else on a timer
+#define ALERT_BLINK_MS    1000
+#define ALERT_MAX_WAKEUPS 20 // whatever the pattern says
+
+static const uint32_t ALERT_SHORT_VIBES[] = { 150, 450, 150, 450, 150 };
+static const uint32_t ALERT_LONG_VIBES[]  = { 800 };
+static const uint32_t ALERT_BRIEF_VIBES[] = { 150 };
+static const struct {
+  const uint32_t *vibes;
+  uint8_t vibe_segments;
+  uint8_t blinks; // on and off once each
+} ALERT_PATTERNS[ALERT_MODE_COUNT] = {
+  [ALERT_MODE_SHORT]  = { ALERT_SHORT_VIBES, ARRAY_LENGTH(ALERT_SHORT_VIBES), 8 },
+  [ALERT_MODE_LONG]   = { ALERT_LONG_VIBES,  ARRAY_LENGTH(ALERT_LONG_VIBES),  8 },
+  [ALERT_MODE_SILENT] = { NULL, 0, 8 },
+  [ALERT_MODE_BRIEF]  = { ALERT_BRIEF_VIBES, ARRAY_LENGTH(ALERT_BRIEF_VIBES), 3 },
+};
+
+void handle_bluetooth(bool connected);
+
+void handle_alert_timer(void *data) {
+  alert_timer = NULL;
+  alert_blink();
+}
+
+// wake up by timer only if the tick does not already
+void alert_schedule() {
+  if (alert_timer && (!alert_blinks || tick_units == SECOND_UNIT)) {
+    app_timer_cancel(alert_timer);
+    alert_timer = NULL;
+  } else if (!alert_timer && alert_blinks && tick_units != SECOND_UNIT) {
+    alert_timer = app_timer_register(ALERT_BLINK_MS, handle_alert_timer, NULL);
+  }
+}
+
+void alert_blink() {
+  alert_blinks--;
+  if (alert_blinks) {
+    // only the 13x13 icon layer is marked dirty
+    bitmap_layer_set_bitmap(bluetooth_layer, bluetooth_images[alert_blinks & 1]);
+    alert_schedule();
+  } else {
+    handle_bluetooth(bluetooth_connection_service_peek());
+  }
+}
+
+void alert_start() {
+  int mode = alert_mode >= 0 && alert_mode < ALERT_MODE_COUNT ? alert_mode : ALERT_MODE_SHORT;
+  if (ALERT_PATTERNS[mode].vibe_segments)
+    vibes_enqueue_custom_pattern((VibePattern) {
+      .durations = ALERT_PATTERNS[mode].vibes,
+      .num_segments = ALERT_PATTERNS[mode].vibe_segments,
+    });
+  alert_blinks = min(2 * ALERT_PATTERNS[mode].blinks, ALERT_MAX_WAKEUPS);
+  bitmap_layer_set_bitmap(bluetooth_layer, bluetooth_images[false]);
+  layer_set_hidden(bitmap_layer_get_layer(bluetooth_layer), false);
+  alert_schedule();
+}
+
+void alert_stop() {
+  alert_blinks = 0;
+  alert_schedule();
+  vibes_cancel();
+}
 
 void handle_bluetooth(bool connected) {
-  bitmap_layer_set_bitmap(bluetooth_layer, bluetooth_images[connected ? 1 : 0]);
-  layer_set_hidden(bitmap_layer_get_layer(bluetooth_layer),
-    bluetooth_mode == BLUETOOTH_MODE_NEVER ||
-    (bluetooth_mode == BLUETOOTH_MODE_IFOFF && connected));
+  idle_wake();
+  if (connected && alert_blinks)
+    alert_stop();
+  if (!alert_blinks) {
+    bool hidden = bluetooth_mode == BLUETOOTH_MODE_NEVER ||
+      (bluetooth_mode == BLUETOOTH_MODE_IFOFF && connected);
+    if (!hidden)
+      bitmap_layer_set_bitmap(bluetooth_layer, bluetooth_images[connected]);
+    layer_set_hidden(bitmap_layer_get_layer(bluetooth_layer), hidden);
+  }
   if (was_connected && !connected && connlost_mode == CONNLOST_MODE_WARN)
-      lost_connection_warning((void*) 0);
+    alert_start();
+  if (!was_connected && connected)
+    outbox_resume();
   was_connected = connected;
 }
 
-void lost_connection_warning(void *data) {
-  int count = (int) data;
-  bool on_off = count & 1;
-  // blink icon
-  bitmap_layer_set_bitmap(bluetooth_layer, bluetooth_images[on_off ? 1 : 0]);
-  layer_set_hidden(bitmap_layer_get_layer(bluetooth_layer), false);
-  // buzz 3 times
-  if (count < 6 && !on_off)
-    vibes_short_pulse();
-  if (count < 50) // blink for 15 seconds
-    app_timer_register(300, lost_connection_warning, (void*) (count+1));
-  else // restore bluetooth icon
-    handle_bluetooth(bluetooth_connection_service_peek());
+// battery drain observed in handle_battery, kept across launches
+static struct {
+  int32_t since;   // time of the last change in charge
+  int16_t rate;    // percent per day, 0 if unknown
+  int8_t level;    // charge at that time, -1 if unknown
+} drain = { 0, 0, -1 };
+
+// highest charge of each tier below full
+static const uint8_t POWER_TIER_CHARGE[POWER_TIER_COUNT] = { 100, 30, 20, 10 };
+static const int8_t NIGHT_START[] = { -1, 22, 23, 0 };
+
+void update_drain(BatteryChargeState charge_state) {
+  int32_t clock = time(NULL);
+  if (charge_state.is_plugged || drain.level < 0 || charge_state.charge_percent > drain.level) {
+    // charging tells nothing about drain, start over when unplugged
+    drain.level = charge_state.charge_percent;
+    drain.since = clock;
+  } else if (charge_state.charge_percent < drain.level) {
+    int rate = (drain.level - charge_state.charge_percent) * 24 * 60 * 60 / max(clock - drain.since, 60);
+    rate = min(rate, 1000);
+    drain.rate = drain.rate ? (3 * drain.rate + rate) / 4 : rate;
+    drain.level = charge_state.charge_percent;
+    drain.since = clock;
+  } else {
+    return;
+  }
+  persist_write_data(DRAIN_STATE, &drain, sizeof(drain));
+}
+
+bool is_night() {
+  if (night_mode <= NIGHT_MODE_OFF || night_mode > NIGHT_MODE_0) return false;
+  return (now->tm_hour - NIGHT_START[night_mode] + 24) % 24 < NIGHT_HOURS;
+}
+
+int power_tier_for(int charge) {
+  int tier = POWER_TIER_FULL;
+  while (tier + 1 < POWER_TIER_COUNT && charge <= POWER_TIER_CHARGE[tier + 1])
+    tier++;
+  if (drain.rate > 0) {
+    int hours_left = charge * 24 / drain.rate;
+    if (hours_left < 12) tier = max(tier, POWER_TIER_MINUTE);
+    else if (hours_left < 24) tier = max(tier, POWER_TIER_NO_SECONDS);
+  }
+  if (is_night())
+    tier = max(tier, POWER_TIER_NO_SECONDS);
+  return tier;
+}
+
+// step down right away, but only step back up with some margin so a charge
+// reading that hovers around a threshold does not flap between tiers
+void update_power_tier(BatteryChargeState charge_state) {
+  power_hour = now->tm_hour;
+  int tier = POWER_TIER_FULL;
+  if (charge_state.is_plugged) {
+    // keep full power
+  } else if (power_mode == POWER_MODE_AUTO) {
+    tier = power_tier_for(charge_state.charge_percent);
+    if (tier < power_tier)
+      tier = max(tier, min(power_tier, power_tier_for(charge_state.charge_percent - POWER_HYSTERESIS)));
+  } else if (is_night()) {
+    tier = POWER_TIER_NO_SECONDS;
+  }
+  if (tier != power_tier)
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Power tier %d, drain %d%%/day", tier, drain.rate);
+  power_tier = tier;
+}
+
+void schedule_refresh();
+
+void handle_refresh_timer(void *data) {
+  refresh_timer = NULL;
+  handle_tick(NULL, MINUTE_UNIT);
+  schedule_refresh();
+}
+
+void schedule_refresh() {
+  int period = ULTRA_MINUTES * 60;
+  refresh_timer = app_timer_register((period - time(NULL) % period) * 1000, handle_refresh_timer, NULL);
+}
+
+// a wrist flick wakes the face, and shows the seconds for a while, or
+// longer if already shown
+void handle_tap(AccelAxisType axis, int32_t direction) {
+  idle_wake();
+  if (seconds_mode != SECONDS_MODE_TAP) return;
+  time_t clock = time(NULL);
+  now = localtime(&clock);
+  update_steps();
+  tap_until = clock + TAP_SECONDS_LENGTH[tap_seconds < ARRAY_LENGTH(TAP_SECONDS_LENGTH) ? tap_seconds : TAP_SECONDS_30];
+  handle_layout();
+  if (face.show_seconds) {
+    update_seconds_frame();
+    layer_mark_dirty(seconds_layer);
+  }
+}
+
+// the sweeping second hand, on a timer at the frame rate rather than an
+// animation, which would wake the face at the full animation rate to skip
+// most frames. Each frame is at a whole multiple of its period into the
+// second, so the hand moves by the same angle every time.
+static const uint8_t SWEEP_FPS[] = { 0, 2, 4, 8 };
+static AppTimer *sweep_timer;
+
+void handle_sweep_timer(void *data) {
+  sweep_timer = NULL;
+  time_t seconds;
+  uint16_t ms = time_ms(&seconds, NULL);
+  if (tap_until && seconds >= tap_until) {
+    tap_until = 0;
+    handle_layout(); // the minute ticks would end the burst too late
+    return;
+  }
+  int period = 1000 / face.sweep_fps;
+  sec_angle = (int64_t) TRIG_MAX_ANGLE * (seconds % 60 * 1000 + ms / period * period) / 60000;
+  update_seconds_frame();
+  layer_mark_dirty(seconds_layer);
+  sweep_timer = app_timer_register(period - ms % period, handle_sweep_timer, NULL);
+}
+
+// re-subscribe only when the tick rate actually changes, 0 means
+// refreshing on a timer every ULTRA_MINUTES
+void set_tick_units(int units) {
+  if (units == tick_units) return;
+  bool was_refreshing = tick_units == 0;
+  tick_units = units;
+  tick_timer_service_unsubscribe();
+  if (refresh_timer) {
+    app_timer_cancel(refresh_timer);
+    refresh_timer = NULL;
+  }
+  if (units) {
+    tick_timer_service_subscribe(units, &handle_tick);
+    if (was_refreshing) handle_tick(NULL, MINUTE_UNIT);
+  } else {
+    schedule_refresh();
+  }
+  alert_schedule();
+}
+
+uint16_t face_changes(const Face *a, const Face *b) {
+  return (a->tick_units != b->tick_units ? FACE_TICKS : 0)
+    | (a->quality != b->quality ? FACE_QUALITY : 0)
+    | (a->font_mode != b->font_mode ? FACE_FONT : 0)
+    | (a->sweep_fps != b->sweep_fps ? FACE_SWEEP : 0)
+    | (a->show_seconds != b->show_seconds ? FACE_SECONDS : 0)
+    | (a->show_battery != b->show_battery ? FACE_BATTERY : 0)
+    | (a->show_date != b->show_date ? FACE_DATE : 0)
+    | (a->invert != b->invert ? FACE_COLORS : 0)
+    | (a->face_top != b->face_top || a->date_top != b->date_top || a->battery_top != b->battery_top ? FACE_FRAMES : 0);
 }
 
 void handle_layout() {
+  PROFILE_BEGIN();
   BatteryChargeState charge_state = battery_state_service_peek();
   bool battery_is_low = charge_state.charge_percent <= 20;
-  bool showSeconds = seconds_mode == SECONDS_MODE_ALWAYS
-    || (seconds_mode == SECONDS_MODE_IFNOTLOW && (!battery_is_low || charge_state.is_plugged));
-  bool showBattery = battery_mode == BATTERY_MODE_ALWAYS
-    || (battery_mode == BATTERY_MODE_IF_LOW && battery_is_low)
-    || charge_state.is_plugged;
-  int face_top = PBL_IF_ROUND_ELSE(0, date_pos == DATE_POS_BOTTOM ? 0 : date_pos == DATE_POS_OFF ? 12 : 24);
-  int date_top = date_pos == DATE_POS_TOP ? 0 : EXTENT;
-  int battery_top = date_pos == DATE_POS_TOP ? 168-10-3 : 3;
-  if (hide_seconds != !showSeconds) {
-    hide_seconds = !showSeconds;
-    tick_timer_service_unsubscribe();
-    tick_timer_service_subscribe(hide_seconds ? MINUTE_UNIT : SECOND_UNIT, &handle_tick);
-  }
-  layer_set_hidden(date_layer, date_pos == DATE_POS_OFF);
-  layer_set_hidden(battery_layer, !showBattery);
-  layer_set_frame(background_layer, GRect(0, face_top, EXTENT, EXTENT));
-  layer_set_frame(date_layer, GRect(0, date_top, EXTENT, 24));
-  layer_set_frame(battery_layer, GRect(EXTENT-22-3, battery_top, 22, 10));
-  FG_COLOR = graphics_mode == GRAPHICS_MODE_INVERT ? GColorBlack : GColorWhite;
-  BG_COLOR = graphics_mode == GRAPHICS_MODE_INVERT ? GColorWhite : GColorBlack;
-  window_set_background_color(window, BG_COLOR);
+  update_power_tier(charge_state);
+  if (idle && idle_mode == IDLE_MODE_OFF) {
+    idle = false;
+    layer_mark_dirty(hands_layer);
+  }
+  // the accelerometer only listens for taps if they show the seconds or wake
+  if (tap_subscribed != (seconds_mode == SECONDS_MODE_TAP || idle)) {
+    tap_subscribed = !tap_subscribed;
+    if (tap_subscribed) accel_tap_service_subscribe(&handle_tap);
+    else accel_tap_service_unsubscribe();
+  }
+  if (accel_subscribed != (idle_mode != IDLE_MODE_OFF)) {
+    accel_subscribed = !accel_subscribed;
+    if (accel_subscribed) {
+      accel_data_service_subscribe(0, NULL); // no batches, just keep sampling
+      accel_service_set_sampling_rate(ACCEL_SAMPLING_10HZ);
+    } else {
+      accel_data_service_unsubscribe();
+    }
+  }
+  if (seconds_mode != SECONDS_MODE_TAP) tap_until = 0;
+  if (date_mode < DATE_MODE_FIRST || date_mode > DATE_MODE_LAST)
+    date_mode = DATE_MODE_FIRST;
+  Face next = {
+    .quality = quality_mode != QUALITY_MODE_AUTO ? quality_mode
+      : battery_is_low && !charge_state.is_plugged ? QUALITY_MODE_LOW : QUALITY_MODE_HIGH,
+    .font_mode = date_pos == DATE_POS_OFF ? DATE_MODE_OFF : date_mode,
+    .show_seconds = !idle && power_tier == POWER_TIER_FULL && (seconds_mode == SECONDS_MODE_ALWAYS
+      || (seconds_mode == SECONDS_MODE_IFNOTLOW && (!battery_is_low || charge_state.is_plugged))
+      || (seconds_mode == SECONDS_MODE_TAP && tap_until)),
+    .show_battery = power_tier < POWER_TIER_MINUTE && (battery_mode == BATTERY_MODE_ALWAYS
+      || (battery_mode == BATTERY_MODE_IF_LOW && battery_is_low)
+      || charge_state.is_plugged),
+    .show_date = date_pos != DATE_POS_OFF,
+    .invert = graphics_mode == GRAPHICS_MODE_INVERT,
+    .face_top = PBL_IF_ROUND_ELSE(0, date_pos == DATE_POS_BOTTOM ? 0 : date_pos == DATE_POS_OFF ? 12 : 24),
+    .date_top = date_pos == DATE_POS_TOP ? 0 : EXTENT,
+    .battery_top = date_pos == DATE_POS_TOP ? 168-10-3 : 3,
+  };
+  next.sweep_fps = next.show_seconds && (charge_state.charge_percent > SWEEP_MIN_CHARGE || charge_state.is_plugged)
+    ? SWEEP_FPS[min(sweep_mode, SWEEP_MODE_8)] : 0;
+  next.tick_units = power_tier == POWER_TIER_ULTRA ? 0
+    : next.show_seconds && !next.sweep_fps ? SECOND_UNIT : MINUTE_UNIT;
+  uint16_t changes = face_applied ? face_changes(&face, &next) : FACE_ALL;
+  face = next; // before applying, set_tick_units() may run handle_tick()
+  face_applied = true;
+
+  if (changes & FACE_FONT) {
+    // one font with the glyphs of all locales, see tools/gen_fonts.py
+    if (face.font_mode == DATE_MODE_OFF && font) {
+      fonts_unload_custom_font(font);
+      font = NULL;
+    } else if (face.font_mode != DATE_MODE_OFF && !font) {
+      font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_30));
+    }
+    date_valid = false;
+    layer_mark_dirty(date_layer);
+  }
+  if (changes & FACE_BATTERY) {
+    if (face.show_battery && !battery_path) {
+      battery_path = gpath_create(&BATTERY_POINTS);
+      charge_path = gpath_create(&CHARGE_POINTS);
+    }
+    layer_set_hidden(battery_layer, !face.show_battery);
+  }
+  if (changes & FACE_TICKS)
+    set_tick_units(face.tick_units);
+  if (changes & FACE_SECONDS)
+    layer_set_hidden(seconds_layer, !face.show_seconds);
+  if (changes & FACE_SWEEP) {
+    if (sweep_timer) {
+      app_timer_cancel(sweep_timer);
+      sweep_timer = NULL;
+    }
+    if (face.sweep_fps) handle_sweep_timer(NULL);
+    else if (face.show_seconds) {
+      update_seconds_frame();
+      layer_mark_dirty(seconds_layer);
+    }
+  }
+  if (changes & FACE_DATE)
+    layer_set_hidden(date_layer, !face.show_date);
+  if (changes & FACE_FRAMES) {
+    layer_set_frame(background_layer, GRect(0, face.face_top, EXTENT, EXTENT));
+    layer_set_frame(date_layer, GRect(0, face.date_top, EXTENT, 24));
+    layer_set_frame(battery_layer, GRect(EXTENT-22-3, face.battery_top, 22, 10));
+    invalidate_caches(); // captured at the old position
+  }
+  if (changes & FACE_COLORS) {
+    FG_COLOR = face.invert ? GColorBlack : GColorWhite;
+    BG_COLOR = face.invert ? GColorWhite : GColorBlack;
+    window_set_background_color(window, BG_COLOR);
+    invalidate_caches();
+  }
+  if (changes & (FACE_QUALITY | FACE_COLORS)) {
+    layer_mark_dirty(hands_layer);
+    layer_mark_dirty(seconds_layer);
+  }
+  if (changes & FACE_COLORS)
+    layer_mark_dirty(battery_layer);
+  PROFILE_END(PROBE_LAYOUT);
 }
 
 void handle_battery(BatteryChargeState charge_state) {
+  update_drain(charge_state);
   handle_layout();
-  layer_mark_dirty(battery_layer);
+  telemetry_record(charge_state);
+  if (face.show_battery)
+    layer_mark_dirty(battery_layer);
+}
+
+// all settings as one blob, new fields are only ever appended
+typedef struct {
+  uint8_t version;
+  uint8_t seconds_mode;
+  uint8_t battery_mode;
+  uint8_t date_pos;
+  uint8_t date_mode;
+  uint8_t bluetooth_mode;
+  uint8_t graphics_mode;
+  uint8_t connlost_mode;
+  uint8_t power_mode;
+  uint8_t night_mode;
+  uint8_t alert_mode;
+  uint8_t motion_mode;
+  uint8_t quality_mode;
+  uint8_t tap_seconds;
+  uint8_t idle_mode;
+  uint8_t idle_motion;
+  uint8_t sweep_mode;
+} Config;
+static Config stored_config; // what is in storage, to skip writing an unchanged config
+static AppTimer *config_timer;
+
+Config config_pack() {
+  return (Config) {
+    .version = CONFIG_VERSION,
+    .seconds_mode = seconds_mode,
+    .battery_mode = battery_mode,
+    .date_pos = date_pos,
+    .date_mode = date_mode,
+    .bluetooth_mode = bluetooth_mode,
+    .graphics_mode = graphics_mode,
+    .connlost_mode = connlost_mode,
+    .power_mode = power_mode,
+    .night_mode = night_mode,
+    .alert_mode = alert_mode,
+    .motion_mode = motion_mode,
+    .quality_mode = quality_mode,
+    .tap_seconds = tap_seconds,
+    .idle_mode = idle_mode,
+    .idle_motion = idle_motion,
+    .sweep_mode = sweep_mode,
+  };
+}
+
+void config_unpack(Config config) {
+  seconds_mode = config.seconds_mode;
+  battery_mode = config.battery_mode;
+  date_pos = config.date_pos;
+  date_mode = config.date_mode;
+  bluetooth_mode = config.bluetooth_mode;
+  graphics_mode = config.graphics_mode;
+  connlost_mode = config.connlost_mode;
+  power_mode = config.power_mode;
+  night_mode = config.night_mode;
+  alert_mode = config.alert_mode;
+  motion_mode = config.motion_mode;
+  quality_mode = config.quality_mode;
+  tap_seconds = config.tap_seconds;
+  idle_mode = config.idle_mode;
+  idle_motion = config.idle_motion;
+  sweep_mode = config.sweep_mode;
+}
+
+void config_write() {
+  if (config_timer) {
+    app_timer_cancel(config_timer);
+    config_timer = NULL;
+  }
+  Config config = config_pack();
+  if (memcmp(&config, &stored_config, sizeof(Config)) == 0) return;
+  persist_write_data(CONFIG, &config, sizeof(Config));
+  stored_config = config;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Wrote config");
+}
+
+void handle_config_timer(void *data) {
+  config_timer = NULL;
+  config_write();
+}
+
+// coalesce bursts of messages into one flash write
+void config_write_later() {
+  if (!config_timer || !app_timer_reschedule(config_timer, CONFIG_WRITE_DELAY))
+    config_timer = app_timer_register(CONFIG_WRITE_DELAY, handle_config_timer, NULL);
+}
+
+// bits of each Config field after the version in the CONFIG_WIRE bitstream,
+// see pack_config() in pebble_one.js
+static const uint8_t CONFIG_WIRE_BITS[] = { 2, 2, 2, 3, 2, 1, 1, 1, 2, 2, 1, 2, 2, 2, 2, 2 }; // as many as the mask has bits
+
+// version byte, 16 bit mask of the fields present, then those fields
+// back to back, least significant bit first
+bool config_decode(const uint8_t *data, int length) {
+  if (length < 3 || data[0] != CONFIG_WIRE_VERSION) return false;
+  uint16_t mask = data[1] | data[2] << 8;
+  Config config = config_pack();
+  uint8_t *fields = &config.version + 1;
+  int bit = 24;
+  for (unsigned i = 0; i < sizeof(CONFIG_WIRE_BITS); i++) {
+    if (!(mask & 1 << i)) continue;
+    int value = 0;
+    for (int b = 0; b < CONFIG_WIRE_BITS[i]; b++, bit++) {
+      if (bit >= length * 8) return false;
+      value |= (data[bit / 8] >> bit % 8 & 1) << b;
+    }
+    fields[i] = value;
+  }
+  config_unpack(config);
+  return true;
+}
+
+bool config_read() {
+  if (persist_exists(CONFIG)) {
+    // fields missing from an older version keep their defaults
+    stored_config = config_pack();
+    persist_read_data(CONFIG, &stored_config, sizeof(Config));
+    config_unpack(stored_config);
+    return true;
+  }
+  // one key per setting before 3.2, migrate once
+  bool has_config = true;
+  if (persist_exists(SECONDS_MODE)) seconds_mode = persist_read_int(SECONDS_MODE); else has_config = false;
+  if (persist_exists(BATTERY_MODE)) battery_mode = persist_read_int(BATTERY_MODE); else has_config = false;
+  if (persist_exists(DATE_POS)) date_pos = persist_read_int(DATE_POS); // added in 2.7
+  if (persist_exists(DATE_MODE)) date_mode = persist_read_int(DATE_MODE); else has_config = false;
+  if (persist_exists(BLUETOOTH_MODE)) bluetooth_mode = persist_read_int(BLUETOOTH_MODE); else has_config = false;
+  if (persist_exists(GRAPHICS_MODE)) graphics_mode = persist_read_int(GRAPHICS_MODE); else has_config = false;
+  if (persist_exists(CONNLOST_MODE)) connlost_mode = persist_read_int(CONNLOST_MODE); else has_config = false;
+  if (persist_exists(POWER_MODE)) power_mode = persist_read_int(POWER_MODE); // added in 3.2
+  if (persist_exists(NIGHT_MODE)) night_mode = persist_read_int(NIGHT_MODE); // added in 3.2
+  if (has_config) {
+    config_write();
+    for (int key = SECONDS_MODE; key <= NIGHT_MODE; key++)
+      persist_delete(key);
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Migrated config");
+  }
+  return has_config;
 }
 
 void handle_appmessage_receive(DictionaryIterator *received, void *context) {
-  Tuple *tuple = dict_read_first(received);
-  while (tuple) {
-    switch (tuple->key) {
-      case SECONDS_MODE:
-        seconds_mode = tuple->value->int32;
-        break;
-      case BATTERY_MODE:
-        battery_mode = tuple->value->int32;
-        break;
-      case DATE_POS:
-        date_pos = tuple->value->int32;
-        break;
-      case DATE_MODE:
-        date_mode = tuple->value->int32;
-        break;
-      case BLUETOOTH_MODE:
-        bluetooth_mode = tuple->value->int32;
-        break;
-      case GRAPHICS_MODE:
-        graphics_mode = tuple->value->int32;
-        break;
-      case CONNLOST_MODE:
-        connlost_mode = tuple->value->int32;
-        break;
+#if PROFILE
+  if (dict_find(received, REQUEST_PROFILE)) {
+    profile_dump();
+    return;
+  }
+#endif
+  PROFILE_BEGIN();
+  Config old_config = config_pack();
+  Tuple *tuple = dict_find(received, CONFIG_WIRE);
+  if (tuple) {
+    if (!config_decode(tuple->value->data, tuple->length)) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Bad config version %d", tuple->value->uint8);
+      PROFILE_END(PROBE_RECEIVE);
+      return;
+    }
+  } else { // one int per setting from phones before 3.2
+    tuple = dict_read_first(received);
+    while (tuple) {
+      switch (tuple->key) {
+        case SECONDS_MODE:
+          seconds_mode = tuple->value->int32;
+          break;
+        case BATTERY_MODE:
+          battery_mode = tuple->value->int32;
+          break;
+        case DATE_POS:
+          date_pos = tuple->value->int32;
+          break;
+        case DATE_MODE:
+          date_mode = tuple->value->int32;
+          break;
+        case BLUETOOTH_MODE:
+          bluetooth_mode = tuple->value->int32;
+          break;
+        case GRAPHICS_MODE:
+          graphics_mode = tuple->value->int32;
+          break;
+        case CONNLOST_MODE:
+          connlost_mode = tuple->value->int32;
+          break;
+        case POWER_MODE:
+          power_mode = tuple->value->int32;
+          break;
+        case NIGHT_MODE:
+          night_mode = tuple->value->int32;
+          break;
+        case ALERT_MODE:
+          alert_mode = tuple->value->int32;
+          break;
+        case MOTION_MODE:
+          motion_mode = tuple->value->int32;
+          break;
+        case QUALITY_MODE:
+          quality_mode = tuple->value->int32;
+          break;
+        case TAP_SECONDS:
+          tap_seconds = tuple->value->int32;
+          break;
+        case IDLE_MODE:
+          idle_mode = tuple->value->int32;
+          break;
+        case IDLE_MOTION:
+          idle_motion = tuple->value->int32;
+          break;
+        case SWEEP_MODE:
+          sweep_mode = tuple->value->int32;
+          break;
+      }
+      tuple = dict_read_next(received);
     }
-    tuple = dict_read_next(received);
   }
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Received config");
   has_config = true;
-  handle_bluetooth(bluetooth_connection_service_peek());
-  handle_layout();
-  layer_mark_dirty(battery_layer);
-  layer_mark_dirty(hands_layer);
-  layer_mark_dirty(date_layer);
-  layer_mark_dirty(background_layer);
+  config_write_later();
+  // redraw only what the changed settings affect, see handle_layout()
+  Config config = config_pack();
+  if (memcmp(&config, &old_config, sizeof(Config)) != 0) {
+    if (config.bluetooth_mode != old_config.bluetooth_mode)
+      handle_bluetooth(bluetooth_connection_service_peek());
+    handle_layout();
+    telemetry_record(battery_state_service_peek()); // starts a run of samples for the new config
+  }
+  PROFILE_END(PROBE_RECEIVE);
+  PROFILE_HEAP("config");
 }
 
-void request_config(void) {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Requesting config");
-  Tuplet request_tuple = TupletInteger(REQUEST_CONFIG, 1);
-  DictionaryIterator *iter;
-  app_message_outbox_begin(&iter);
-  if (!iter) return;
-  dict_write_tuplet(iter, &request_tuple);
-  dict_write_end(iter);
-  app_message_outbox_send();
+
+// the face is relaunched after every notification, a relaunch shortly after
+// the exit picks up where it left off: no startup animation, the power tier
+// with its hysteresis, the connection state, so that a disconnect while away
+// still alerts, a running seconds burst, and no second config request when
+// the phone got the first and has none to send
+#define RESUME_WINDOW 300 // s
+
+typedef struct {
+  int32_t time;        // of the exit
+  int32_t tap_until;
+  uint8_t power_tier;
+  bool connected;
+  bool config_asked;   // the phone acked a config request, but sent none
+} Resume;
+
+bool resume_read() {
+  Resume resume;
+  if (persist_read_data(RESUME, &resume, sizeof(resume)) != sizeof(resume)) return false;
+  int32_t clock = time(NULL);
+  if (clock < resume.time || clock - resume.time > RESUME_WINDOW) return false;
+  power_tier = resume.power_tier < POWER_TIER_COUNT ? resume.power_tier : POWER_TIER_FULL;
+  was_connected = resume.connected;
+  if (resume.tap_until > clock) tap_until = resume.tap_until;
+  config_asked = resume.config_asked;
+  return true;
 }
 
+void resume_write() {
+  Resume resume = {
+    .time = time(NULL),
+    .tap_until = tap_until,
+    .power_tier = power_tier,
+    .connected = was_connected,
+    .config_asked = config_asked && !has_config,
+  };
+  persist_write_data(RESUME, &resume, sizeof(resume));
+}
 
 void handle_init() {
+#if PROFILE
+  init_ms = profile_now();
+#endif
   time_t clock = time(NULL);
   now = localtime(&clock);
   window = window_create();
@@ -488,110 +1611,116 @@ void handle_init() {
   layer_set_update_proc(background_layer, &background_layer_update_callback);
   layer_add_child(window_get_root_layer(window), background_layer);
 
-  logo = gbitmap_create_with_resource(RESOURCE_ID_IMAGE_LOGO);
-  gbitmap_set_palette(logo, bw_palette, false);
-  GRect frame = gbitmap_get_bounds(logo);
-  grect_align(&frame, &GRect(0, 0, EXTENT, CENTER_Y), GAlignCenter, false);
-  logo_layer = bitmap_layer_create(frame);
-  bitmap_layer_set_bitmap	(logo_layer, logo);
-  layer_add_child(background_layer, bitmap_layer_get_layer(logo_layer));
+  // the sub-bitmaps share the atlas palette
+  atlas = gbitmap_create_with_resource(RESOURCE_ID_IMAGE_ATLAS);
+  gbitmap_set_palette(atlas, bw_palette, false);
+  logo = gbitmap_create_as_sub_bitmap(atlas, SPRITE_LOGO);
+  bluetooth_images[false] = gbitmap_create_as_sub_bitmap(atlas, SPRITE_BLUETOOTH_OFF);
+  bluetooth_images[true] = gbitmap_create_as_sub_bitmap(atlas, SPRITE_BLUETOOTH_ON);
+  PROFILE_HEAP("bitmaps");
+  logo_frame = gbitmap_get_bounds(logo);
+  grect_align(&logo_frame, &GRect(0, 0, EXTENT, CENTER_Y), GAlignCenter, false);
+  for (int i = 0; i < 12; i++) {
+    plate_rects[i] = GRect(
+      CENTER_X + DOT_CENTERS[i][0] - DOTS_SIZE,
+      CENTER_Y + DOT_CENTERS[i][1] - DOTS_SIZE,
+      2 * DOTS_SIZE + 1, 2 * DOTS_SIZE + 1);
+  }
+  plate_rects[12] = logo_frame;
 
   hands_layer = layer_create(layer_get_frame(background_layer));
   layer_set_update_proc(hands_layer, &hands_layer_update_callback);
   layer_add_child(background_layer, hands_layer);
 
+  seconds_layer = layer_create(layer_get_frame(background_layer));
+  layer_set_update_proc(seconds_layer, &seconds_layer_update_callback);
+  layer_add_child(background_layer, seconds_layer);
+
   battery_layer = layer_create(GRect(EXTENT-22-3, 3, 22, 10));
   layer_set_update_proc(battery_layer, &battery_layer_update_callback);
   layer_add_child(window_get_root_layer(window), battery_layer);
 
-  for (int i = 0; i < 2; i++) {
-    bluetooth_images[i] = gbitmap_create_with_resource(RESOURCE_ID_IMAGE_BLUETOOTH_OFF + i);  
-    gbitmap_set_palette(bluetooth_images[i], bw_palette, false);
-  }
   bluetooth_layer = bitmap_layer_create(GRect(CENTER_X - 6, CENTER_Y - DOTS_RADIUS - 4, 13, 13));
   layer_add_child(background_layer, bitmap_layer_get_layer(bluetooth_layer));
+  PROFILE_HEAP("layers");
 
-#if DEBUG
-  debug_layer = text_layer_create(GRect(0, 0, 32, 16));
-  strcpy(debug_buffer, "");
-  text_layer_set_text(debug_layer, debug_buffer);
-  text_layer_set_text_color(debug_layer, FG_COLOR);
-  text_layer_set_background_color(debug_layer, BG_COLOR);
-  layer_add_child(window_get_root_layer(window), text_layer_get_layer(debug_layer));
-#endif
-  
-  hour_path = gpath_create(&HOUR_POINTS);
+  hour_path = gpath_create(&(GPathInfo) { HOUR_POINT_COUNT, hour_points });
   gpath_move_to(hour_path, GPoint(CENTER_X, CENTER_Y));
-  min_path = gpath_create(&MIN_POINTS);
+  min_path = gpath_create(&(GPathInfo) { MIN_POINT_COUNT, min_points });
   gpath_move_to(min_path, GPoint(CENTER_X, CENTER_Y));
-  sec_path = gpath_create(&SEC_POINTS);
+  sec_path = gpath_create(&(GPathInfo) { SEC_POINT_COUNT, sec_points });
   gpath_move_to(sec_path, GPoint(CENTER_X, CENTER_Y));
-  battery_path = gpath_create(&BATTERY_POINTS);
-  charge_path = gpath_create(&CHARGE_POINTS);
+  PROFILE_HEAP("paths");
+
+  has_config = config_read();
+  if (has_config) APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded config");
+  if (persist_exists(DRAIN_STATE)) persist_read_data(DRAIN_STATE, &drain, sizeof(drain));
+  update_drain(battery_state_service_peek());
+  resumed = resume_read();
+  handle_layout();
+  PROFILE_HEAP("font");
 
-  startup_animation = animation_create();
-  animation_set_curve(startup_animation, AnimationCurveEaseOut);
-  animation_set_implementation(startup_animation, &startup_animation_implementation);
   startup_animation_init();
+  PROFILE_HEAP("animation");
   app_focus_service_subscribe_handlers((AppFocusHandlers){
     .did_focus = handle_app_did_focus,
   });
-
-  font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_30));
-
-  has_config = true;
-  if (persist_exists(SECONDS_MODE)) seconds_mode = persist_read_int(SECONDS_MODE); else has_config = false;
-  if (persist_exists(BATTERY_MODE)) battery_mode = persist_read_int(BATTERY_MODE); else has_config = false;
-  if (persist_exists(DATE_POS)) date_pos = persist_read_int(DATE_POS); // added in 2.7
-  if (persist_exists(DATE_MODE)) date_mode = persist_read_int(DATE_MODE); else has_config = false;
-  if (persist_exists(BLUETOOTH_MODE)) bluetooth_mode = persist_read_int(BLUETOOTH_MODE); else has_config = false;
-  if (persist_exists(GRAPHICS_MODE)) graphics_mode = persist_read_int(GRAPHICS_MODE); else has_config = false;
-  if (persist_exists(CONNLOST_MODE)) connlost_mode = persist_read_int(CONNLOST_MODE); else has_config = false;
-  if (has_config) APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded config");
-  tick_timer_service_subscribe(hide_seconds ? MINUTE_UNIT : SECOND_UNIT, &handle_tick);
-  handle_layout();
   battery_state_service_subscribe(&handle_battery);
   bluetooth_connection_service_subscribe(&handle_bluetooth);
   handle_bluetooth(bluetooth_connection_service_peek());
+}
+
+// everything the first frame does not need, run once it is on screen
+void handle_deferred_init(void *data) {
   app_message_register_inbox_received(&handle_appmessage_receive);
+  app_message_register_outbox_sent(&handle_outbox_sent);
+  app_message_register_outbox_failed(&handle_outbox_failed);
   app_message_open(INBOX_SIZE, OUTBOX_SIZE);
-  if (!has_config) request_config();
+  PROFILE_HEAP("app message");
+  config_requested = !has_config && !config_asked; // goes out with the first telemetry batch
+  if (persist_exists(TELEMETRY_LOG)) persist_read_data(TELEMETRY_LOG, &telemetry, sizeof(telemetry));
+  telemetry_loaded = true;
+  telemetry_record(battery_state_service_peek());
+  outbox_send(); // if there was no new sample
 }
 
 void handle_deinit() {
+#if PROFILE
+  profile_dump();
+#endif
+  resume_write();
   app_message_deregister_callbacks();
   battery_state_service_unsubscribe();
   tick_timer_service_unsubscribe();
-  if (has_config) {
-    persist_write_int(SECONDS_MODE, seconds_mode);
-    persist_write_int(BATTERY_MODE, battery_mode);
-    persist_write_int(DATE_POS, date_pos);
-    persist_write_int(DATE_MODE, date_mode);
-    persist_write_int(BLUETOOTH_MODE, bluetooth_mode);
-    persist_write_int(GRAPHICS_MODE, graphics_mode);
-    persist_write_int(CONNLOST_MODE, connlost_mode);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Wrote config");
-  } else {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Did not write config");
-  }
-  fonts_unload_custom_font(font);
+  if (tap_subscribed) accel_tap_service_unsubscribe();
+  if (accel_subscribed) accel_data_service_unsubscribe();
+  if (refresh_timer) app_timer_cancel(refresh_timer);
+  if (alert_timer) app_timer_cancel(alert_timer);
+  if (outbox_retry_timer) app_timer_cancel(outbox_retry_timer);
+  if (sweep_timer) app_timer_cancel(sweep_timer);
+  if (config_timer) config_write(); // still pending from a recent change
+  if (font) fonts_unload_custom_font(font);
   app_focus_service_unsubscribe();
   animation_unschedule_all();
-  gpath_destroy(charge_path);
-  gpath_destroy(battery_path);
+  if (startup_animation) animation_destroy(startup_animation); // never got focus
+  if (startup_frames) free(startup_frames);
+  if (battery_path) {
+    gpath_destroy(charge_path);
+    gpath_destroy(battery_path);
+  }
   gpath_destroy(sec_path);
   gpath_destroy(min_path);
   gpath_destroy(hour_path);
-#if DEBUG
-  text_layer_destroy(debug_layer);
-#endif
+  layer_destroy(seconds_layer);
   layer_destroy(hands_layer);
-  bitmap_layer_destroy(logo_layer);
-  gbitmap_destroy(logo);
+  if (plate) gbitmap_destroy(plate);
+  if (date_cache) gbitmap_destroy(date_cache);
   layer_destroy(battery_layer);
   bitmap_layer_destroy(bluetooth_layer);
-  for (int i = 0; i < 2; i++)
-    gbitmap_destroy(bluetooth_images[i]);
+  gbitmap_destroy(logo);
+  gbitmap_destroy(bluetooth_images[false]);
+  gbitmap_destroy(bluetooth_images[true]);
+  gbitmap_destroy(atlas);
   layer_destroy(background_layer);
   layer_destroy(date_layer);
   window_destroy(window);
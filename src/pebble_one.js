@@ -24,6 +24,7 @@
 var SECONDS_MODE_NEVER    = 0,
     SECONDS_MODE_IFNOTLOW = 1,
     SECONDS_MODE_ALWAYS   = 2,
+    SECONDS_MODE_TAP      = 3,
     BATTERY_MODE_NEVER    = 0,
     BATTERY_MODE_IF_LOW   = 1,
     BATTERY_MODE_ALWAYS   = 2,
@@ -44,6 +45,40 @@ var SECONDS_MODE_NEVER    = 0,
     GRAPHICS_MODE_INVERT  = 1,
     CONNLOST_MODE_IGNORE  = 0,
     CONNLOST_MODE_WARN    = 1,
+    POWER_MODE_OFF        = 0,
+    POWER_MODE_AUTO       = 1,
+    NIGHT_MODE_OFF        = 0,
+    NIGHT_MODE_22         = 1,
+    NIGHT_MODE_23         = 2,
+    NIGHT_MODE_0          = 3,
+    ALERT_MODE_SHORT      = 0,
+    ALERT_MODE_LONG       = 1,
+    ALERT_MODE_SILENT     = 2,
+    ALERT_MODE_BRIEF      = 3,
+    MOTION_MODE_FULL      = 0,
+    MOTION_MODE_REDUCED   = 1,
+    QUALITY_MODE_AUTO     = 0,
+    QUALITY_MODE_HIGH     = 1,
+    QUALITY_MODE_BALANCED = 2,
+    QUALITY_MODE_LOW      = 3,
+    TAP_SECONDS_10        = 0,
+    TAP_SECONDS_30        = 1,
+    TAP_SECONDS_60        = 2,
+    IDLE_MODE_OFF         = 0,
+    IDLE_MODE_15          = 1,
+    IDLE_MODE_30          = 2,
+    IDLE_MODE_60          = 3,
+    IDLE_MOTION_SLIGHT    = 0,
+    IDLE_MOTION_SOME      = 1,
+    IDLE_MOTION_STRONG    = 2,
+    SWEEP_MODE_OFF        = 0,
+    SWEEP_MODE_2          = 1,
+    SWEEP_MODE_4          = 2,
+    SWEEP_MODE_8          = 3,
+    TELEMETRY_SAMPLE_BYTES = 8,  // see TelemetrySample in pebble_one.c
+    TELEMETRY_PLUGGED     = 1,
+    TELEMETRY_CHARGING    = 2,
+    TELEMETRY_MAX_SAMPLES = 1000,
     LOCALE_MODE_EN        = 0,
     LOCALE_MODE_DE        = 1,
     LOCALE_MODE_COUNT     = 2;
@@ -56,32 +91,185 @@ var config = {
     bluetooth_mode: BLUETOOTH_MODE_ALWAYS,
     graphics_mode:  GRAPHICS_MODE_INVERT,
     connlost_mode:  CONNLOST_MODE_WARN,
+    power_mode:     POWER_MODE_OFF,
+    night_mode:     NIGHT_MODE_OFF,
+    alert_mode:     ALERT_MODE_SHORT,
+    motion_mode:    MOTION_MODE_FULL,
+    quality_mode:   QUALITY_MODE_AUTO,
+    tap_seconds:    TAP_SECONDS_30,
+    idle_mode:      IDLE_MODE_OFF,
+    idle_motion:    IDLE_MOTION_SOME,
+    sweep_mode:     SWEEP_MODE_OFF,
 };
 
-var send_in_progress = false;
+// config sends to the watch: one in flight, changes made meanwhile are
+// sent as one when it is done, failed sends are retried with backoff
+var CONFIG_RETRY_MS = 1000,     // doubled after each failure
+    CONFIG_RETRY_MAX_MS = 64000,
+    CONFIG_MAX_RETRIES = 8;     // then wait for the next ready or message
+var send_in_progress = false,
+    send_pending = false,
+    send_pending_full = false,
+    send_retries = 0,
+    send_retry_timer = null;
 
-// config.html will be included by build process, see build/src/js/pebble-js-app.js
-var config_html; 
+// set together with PROFILE in pebble_one.c to have the watch log its
+// callback timings whenever the config page is opened
+var PROFILE = false;
 
-function send_config_to_pebble() {
+// the data: URL of config.html, encoded by the build process around where the
+// config goes, see tools/gen_config.py and build/src/js/pebble-js-app.js
+var config_html;
+
+// settings in the config byte array, in the order and with the widths
+// that config_decode() in pebble_one.c expects
+var CONFIG_WIRE_VERSION = 1,
+    CONFIG_WIRE_FIELDS = [
+        ['seconds_mode', 2], ['battery_mode', 2], ['date_pos', 2], ['date_mode', 3],
+        ['bluetooth_mode', 2], ['graphics_mode', 1], ['connlost_mode', 1],
+        ['power_mode', 1], ['night_mode', 2], ['alert_mode', 2],
+        ['motion_mode', 1], ['quality_mode', 2], ['tap_seconds', 2],
+        ['idle_mode', 2], ['idle_motion', 2], ['sweep_mode', 2]]; // 16 at most, one per mask bit
+
+// version, mask of the fields present, then those fields as bitfields,
+// only the ones that differ from previous if given
+function pack_config(config, previous) {
+    var bytes = [CONFIG_WIRE_VERSION, 0, 0],
+        mask = 0,
+        bit = 0;
+    CONFIG_WIRE_FIELDS.forEach(function (field, i) {
+        var name = field[0], bits = field[1];
+        if (previous && previous[name] === config[name]) {
+            return;
+        }
+        mask |= 1 << i;
+        for (var b = 0; b < bits; b++, bit++) {
+            if (bit % 8 === 0) {
+                bytes.push(0);
+            }
+            bytes[3 + (bit >> 3)] |= (config[name] >> b & 1) << (bit & 7);
+        }
+    });
+    bytes[1] = mask & 0xFF;
+    bytes[2] = mask >> 8;
+    return mask ? bytes : null;
+}
+
+// send all of the config if the watch has none, otherwise only what it
+// does not have yet according to the last acked message
+function send_config_to_pebble(full) {
     if (send_in_progress) {
-        return console.log("cannot send config, already in progress");
+        send_pending = true;
+        send_pending_full = send_pending_full || full;
+        return console.log("config send queued");
+    }
+    if (send_retry_timer) {
+        clearTimeout(send_retry_timer);
+        send_retry_timer = null;
+    }
+    var json = window.localStorage.getItem('watchConfig');
+    var previous = !full && typeof json === 'string' ? JSON.parse(json) : null;
+    var sent = JSON.parse(JSON.stringify(config));
+    var bytes = pack_config(sent, previous);
+    if (!bytes) {
+        window.localStorage.removeItem('pebbleNeedsConfig');
+        return console.log("watch config is up to date");
     }
     send_in_progress = true;
-    console.log("sending config " + JSON.stringify(config)); 
+    console.log("sending config " + JSON.stringify(config) + " as " + JSON.stringify(bytes));
     window.localStorage.setItem('pebbleNeedsConfig', 'true');
-    Pebble.sendAppMessage(config,
+    Pebble.sendAppMessage({ config: bytes },
         function ack(e) {
             console.log("Successfully delivered message " + JSON.stringify(e.data));
             send_in_progress = false;
+            send_retries = 0;
+            window.localStorage.setItem('watchConfig', JSON.stringify(sent));
             window.localStorage.removeItem('pebbleNeedsConfig');
+            send_queued_config();
         },
         function nack(e) {
             console.log("Unable to deliver message " + JSON.stringify(e));
             send_in_progress = false;
+            if (send_pending) {
+                send_pending_full = send_pending_full || full; // the queued send replaces this one
+                return send_queued_config();
+            }
+            if (send_retries >= CONFIG_MAX_RETRIES) {
+                return console.log("giving up on sending config");
+            }
+            var delay = Math.min(CONFIG_RETRY_MS << send_retries, CONFIG_RETRY_MAX_MS);
+            send_retries++;
+            send_retry_timer = setTimeout(function () {
+                send_retry_timer = null;
+                send_config_to_pebble(full);
+            }, delay);
         });
 }
 
+// whatever changed while a send was in flight, against the now acked state
+function send_queued_config() {
+    if (send_pending) {
+        var full = send_pending_full;
+        send_pending = false;
+        send_pending_full = false;
+        send_config_to_pebble(full);
+    }
+}
+
+// key for grouping samples, same bits as telemetry_config() on the watch
+function telemetry_config_name(config) {
+    return "seconds_mode=" + (config & 3) +
+        " graphics_mode=" + (config >> 2 & 1) +
+        " date_pos=" + (config >> 3 & 3) +
+        " power_tier=" + (config >> 5 & 3);
+}
+
+// charge lost between two samples on battery counts for the config of the earlier one
+function drain_per_config(samples) {
+    var totals = {};
+    for (var i = 1; i < samples.length; i++) {
+        var a = samples[i-1], b = samples[i];
+        if ((a.flags | b.flags) & TELEMETRY_PLUGGED || b.charge > a.charge) {
+            continue;
+        }
+        var name = telemetry_config_name(a.config);
+        var total = totals[name] || (totals[name] = { percent: 0, hours: 0 });
+        total.percent += a.charge - b.charge;
+        total.hours += (b.time - a.time) / 3600;
+    }
+    var rates = {};
+    for (var key in totals) {
+        if (totals[key].hours > 0) {
+            rates[key] = Math.round(totals[key].percent / totals[key].hours * 100) / 100;
+        }
+    }
+    return rates;
+}
+
+// append a batch of battery samples from the watch and update the %/hour per config
+function store_telemetry(bytes) {
+    var samples = JSON.parse(window.localStorage.getItem('telemetry') || '[]');
+    var last = samples.length ? samples[samples.length - 1].time : 0;
+    for (var i = 0; i + TELEMETRY_SAMPLE_BYTES <= bytes.length; i += TELEMETRY_SAMPLE_BYTES) {
+        var sample = {
+            time: bytes[i] | bytes[i+1] << 8 | bytes[i+2] << 16 | bytes[i+3] << 24,
+            charge: bytes[i+4],
+            flags: bytes[i+5],
+            config: bytes[i+6],
+        };
+        if (sample.time <= last) { // resent after a lost ack
+            continue;
+        }
+        samples.push(sample);
+        last = sample.time;
+    }
+    samples = samples.slice(-TELEMETRY_MAX_SAMPLES);
+    window.localStorage.setItem('telemetry', JSON.stringify(samples));
+    var rates = drain_per_config(samples);
+    window.localStorage.setItem('drain_per_config', JSON.stringify(rates));
+    console.log("battery drain in %/hour " + JSON.stringify(rates));
+}
+
 // read config from persistent storage
 Pebble.addEventListener('ready',
     function () {
@@ -94,6 +282,29 @@ Pebble.addEventListener('ready',
             } else if (config.date_pos === null) {
                 config.date_pos = DATE_POS_BOTTOM;
             }
+            if (config.power_mode === undefined) { // version 3.2 introduced power saving
+                config.power_mode = POWER_MODE_OFF;
+                config.night_mode = NIGHT_MODE_OFF;
+            }
+            if (config.alert_mode === undefined) { // version 3.2 introduced alert patterns
+                config.alert_mode = ALERT_MODE_SHORT;
+            }
+            if (config.motion_mode === undefined) { // version 3.2 introduced reduced motion
+                config.motion_mode = MOTION_MODE_FULL;
+            }
+            if (config.quality_mode === undefined) { // version 3.2 introduced quality tiers
+                config.quality_mode = QUALITY_MODE_AUTO;
+            }
+            if (config.tap_seconds === undefined) { // version 3.2 introduced seconds on tap
+                config.tap_seconds = TAP_SECONDS_30;
+            }
+            if (config.idle_mode === undefined) { // version 3.2 introduced minute ticks when still
+                config.idle_mode = IDLE_MODE_OFF;
+                config.idle_motion = IDLE_MOTION_SOME;
+            }
+            if (config.sweep_mode === undefined) { // version 3.2 introduced the sweeping second hand
+                config.sweep_mode = SWEEP_MODE_OFF;
+            }
             console.log("loaded config " + JSON.stringify(config));
         }
         if (window.localStorage.getItem('pebbleNeedsConfig')) {
@@ -106,16 +317,25 @@ Pebble.addEventListener("appmessage",
     function(e) {
         console.log("got message " + JSON.stringify(e.payload));
         if (e.payload.request_config) {
+            send_config_to_pebble(true);
+        } else if (window.localStorage.getItem('pebbleNeedsConfig') && !send_in_progress) {
+            // the watch is back, e.g. after a reconnect, don't wait for the backoff
+            send_retries = 0;
             send_config_to_pebble();
         }
+        if (e.payload.telemetry) {
+            store_telemetry(e.payload.telemetry);
+        }
     });
 
 // open config window
 Pebble.addEventListener('showConfiguration',
     function () {
         console.log("show config window " + JSON.stringify(config));
-        var html = config_html.replace('"REPLACE_ME_AT_RUNTIME"', JSON.stringify(config), 'g');
-        Pebble.openURL('data:text/html,' + encodeURIComponent(html + '<!--.html'));
+        if (PROFILE) {
+            Pebble.sendAppMessage({ request_profile: 1 });
+        }
+        Pebble.openURL(config_html[0] + encodeURIComponent(JSON.stringify(config)) + config_html[1]);
     });
 
 // store config and send to watch
@@ -0,0 +1,138 @@
+#!/usr/bin/env python
+#
+# Pack the face's images into one 1-bit sprite atlas, so the face loads a
+# single resource and cuts the sprites out of it as sub-bitmaps.
+#
+# With output files, writes the atlas as a two-color indexed PNG, palette
+# index 0 for the background (black in the artwork) and 1 for the foreground
+# (white), which the face recolors with its own palette, and atlas.auto.h
+# with the rectangle of each sprite, both in one go so they always match.
+# Either is only rewritten if it changed. Without, only prints the header.
+# The sprites sit side by side, each starting on a byte boundary so that
+# blitting one copies whole bytes of the 1-bit rows.
+#
+#   python gen_atlas.py resources/images resources/images/atlas.auto.png build/src/atlas.auto.h
+#   python gen_atlas.py resources/images > atlas.auto.h
+
+import os
+import struct
+import sys
+import zlib
+
+SPRITES = [
+    ('LOGO',          'pebble9x4.png'),
+    ('BLUETOOTH_OFF', 'bluetooth_off.png'),
+    ('BLUETOOTH_ON',  'bluetooth_on.png'),
+]
+ALIGN = 8
+
+
+def chunks(data):
+    pos = 8
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        yield kind, data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    return a if pa <= pb and pa <= pc else b if pb <= pc else c
+
+
+# rows of booleans, true where the pixel is opaque and light
+def read_png(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    assert data[:8] == b'\x89PNG\r\n\x1a\n', path + ' is not a PNG'
+    idat = b''
+    for kind, body in chunks(data):
+        if kind == b'IHDR':
+            width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', body)
+        elif kind == b'IDAT':
+            idat += body
+    assert depth == 8 and color in (2, 6) and not interlace, path + ' is not 8 bit RGB(A)'
+    bpp = 4 if color == 6 else 3
+    stride = width * bpp
+    raw = bytearray(zlib.decompress(idat))
+    prev = bytearray(stride)
+    rows = []
+    for y in range(height):
+        start = y * (stride + 1)
+        kind, line = raw[start], raw[start + 1:start + 1 + stride]
+        for x in range(stride):
+            a = line[x - bpp] if x >= bpp else 0
+            b = prev[x]
+            c = prev[x - bpp] if x >= bpp else 0
+            line[x] = (line[x] + (0, a, b, (a + b) // 2, paeth(a, b, c))[kind]) & 0xff
+        pixels = [line[x * bpp:x * bpp + bpp] for x in range(width)]
+        rows.append([(bpp == 3 or p[3] >= 128) and sum(p[:3]) >= 3 * 128 for p in pixels])
+        prev = line
+    return rows
+
+
+def layout(images):
+    sprites, x = [], 0
+    for name, file in SPRITES:
+        rows = read_png(os.path.join(images, file))
+        sprites.append((name, x, len(rows[0]), len(rows), rows))
+        x = (x + len(rows[0]) + ALIGN - 1) // ALIGN * ALIGN
+    width = sprites[-1][1] + sprites[-1][2]
+    height = max(sprite[3] for sprite in sprites)
+    return sprites, width, height
+
+
+def png_chunk(kind, body):
+    return struct.pack('>I', len(body)) + kind + body + struct.pack('>I', zlib.crc32(kind + body) & 0xffffffff)
+
+
+def write_if_changed(path, data):
+    if os.path.exists(path):
+        with open(path, 'rb') as f:
+            if f.read() == data:
+                return
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def png(sprites, width, height):
+    bits = [[0] * width for y in range(height)]
+    for name, left, w, h, rows in sprites:
+        for y in range(h):
+            for x in range(w):
+                bits[y][left + x] = int(rows[y][x])
+    raw = bytearray()
+    for row in bits:
+        raw.append(0)
+        for x in range(0, width, 8):
+            byte = 0
+            for bit in row[x:x + 8] + [0] * (x + 8 - width):
+                byte = byte << 1 | bit
+            raw.append(byte)
+    return (b'\x89PNG\r\n\x1a\n' +
+        png_chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 1, 3, 0, 0, 0)) +
+        png_chunk(b'PLTE', b'\x00\x00\x00\xff\xff\xff') +
+        png_chunk(b'IDAT', zlib.compress(bytes(raw), 9)) +
+        png_chunk(b'IEND', b''))
+
+
+def header(sprites, width, height):
+    out = ['// generated by tools/gen_atlas.py from resources/images, do not edit', '']
+    out.append('// RESOURCE_ID_IMAGE_ATLAS is %dx%d, the sprites are cut from it' % (width, height))
+    for name, x, w, h, rows in sprites:
+        out.append('#define SPRITE_%-14s GRect(%2d, 0, %2d, %2d)' % (name, x, w, h))
+    return '\n'.join(out) + '\n'
+
+
+def main(images, atlas_png=None, atlas_h=None):
+    sprites, width, height = layout(images)
+    if atlas_png:
+        write_if_changed(atlas_png, png(sprites, width, height))
+        write_if_changed(atlas_h, header(sprites, width, height).encode('ascii'))
+    else:
+        sys.stdout.write(header(sprites, width, height))
+
+
+if __name__ == '__main__':
+    main(*sys.argv[1:])
@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Generate config.js for pebble_one.js from config.html: the page minified
+# and URI-encoded once at build time, as the data: URL that showConfiguration
+# opens, split at the config slot. At runtime only the config JSON is encoded
+# and spliced in between the two halves.
+#
+# Minifying drops comments, indentation and the quotes around simple attribute
+# values, joins lines and squeezes the CSS. The script in the page is only
+# joined, so it must not use // comments.
+#
+#   python gen_config.py src/config.html > config.js
+
+import io
+import json
+import re
+import sys
+
+try:
+    from urllib.parse import quote
+except ImportError:
+    from urllib import quote
+
+SLOT = '/*CONFIG*/{}'
+PREFIX = 'data:text/html,'
+SUFFIX = '<!--.html' # some phones only open data: URLs ending in .html
+
+
+def squeeze_css(match):
+    css = re.sub(r'\s*([{}:;,])\s*', r'\1', match.group(2))
+    return match.group(1) + css.replace(';}', '}') + match.group(3)
+
+
+def unquote_attributes(match):
+    return re.sub(r'="([\w.-]+)"', r'=\1', match.group(0))
+
+
+def minify(html):
+    html = re.sub(r'<!--.*?-->', '', html, flags=re.S)
+    html = ' '.join(line.strip() for line in html.splitlines() if line.strip())
+    html = re.sub(r'>\s+<', '><', html)
+    html = re.sub(r'<(?!/?script)[^<>]*>', unquote_attributes, html)
+    return re.sub(r'(<style>)(.*?)(</style>)', squeeze_css, html, flags=re.S)
+
+
+def encode(text):
+    # like encodeURI, which leaves the page readable and short, but with
+    # the # of colors and the % of CSS encoded too
+    return quote(text.encode('utf-8'), safe="-_.!~*'();,/?:@&=+$")
+
+
+def main(config_html):
+    with io.open(config_html, encoding='utf-8') as f:
+        html = f.read()
+    assert html.count(SLOT) == 1, 'expected one ' + SLOT + ' in ' + config_html
+    head, tail = html.split(SLOT)
+    parts = [PREFIX + encode(minify(head) + ' '), encode(' ' + minify(tail) + SUFFIX)]
+    sys.stdout.write('// generated by tools/gen_config.py from src/config.html\n')
+    sys.stdout.write('config_html = [\n    %s,\n    %s];\n' % tuple(json.dumps(part) for part in parts))
+
+
+if __name__ == '__main__':
+    main(sys.argv[1])
@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Generate the date font resource in appinfo.json: FONT_30, limited to the
+# glyphs of the weekday names of all date languages in src/pebble_one.c plus
+# the digits and space for the day of month. One font for all languages, as
+# every subset would ship in the resource pack anyway, while the glyphs of a
+# custom font are loaded from the resource as they are drawn.
+#
+# The font entries are expected at the end of the "media" list, where they
+# are replaced as a whole. appinfo.json is only rewritten if they changed.
+#
+#   python gen_fonts.py src/pebble_one.c appinfo.json
+
+import io
+import re
+import sys
+
+FONT_NAME = 'FONT_30'
+FONT_FILE = 'fonts/VarelaRound-Regular.ttf'
+ALWAYS = u' 0123456789'
+
+
+def parse(source):
+    modes = re.findall(r'#define DATE_MODE_([A-Z]{2})\s+(\d+)', source)
+    locales = [name for name, value in sorted(modes, key=lambda m: int(m[1]))]
+    table = re.search(r'WEEKDAY_NAMES\[.*?\] = \{(.*?)\n\};', source, re.S).group(1)
+    rows = re.findall(r'\{(.*?)\}', table)
+    names = [re.findall(r'"(.*?)"', row) for row in rows]
+    assert len(locales) == len(names), (locales, len(names))
+    return list(zip(locales, names))
+
+
+def char_class(chars):
+    escaped = u''.join(u'\\' + c if c in u'\\]^-' else c for c in sorted(chars))
+    return u'[' + escaped + u']'
+
+
+def entry(weekdays):
+    chars = set(ALWAYS)
+    for locale, names in weekdays:
+        chars |= set(u''.join(names))
+    return u'      { "type": "font", "name": "%s", "file": "%s", "characterRegex": "%s" }' % (
+        FONT_NAME, FONT_FILE, char_class(chars))
+
+
+def main(face_c, appinfo_json):
+    with io.open(face_c, encoding='utf-8') as f:
+        weekdays = parse(f.read())
+    with io.open(appinfo_json, encoding='utf-8') as f:
+        appinfo = f.read()
+    fonts = re.compile(r'(,\s*\{[^{}]*"type":\s*"font"[^{}]*\})+(?=\s*\])', re.S)
+    assert fonts.search(appinfo), 'no font resources at the end of media in ' + appinfo_json
+    updated = fonts.sub(lambda m: u',\n' + entry(weekdays), appinfo, count=1)
+    if updated != appinfo:
+        with io.open(appinfo_json, 'w', encoding='utf-8') as f:
+            f.write(updated)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,110 @@
+#!/usr/bin/env python
+#
+# Generate geometry.auto.h for src/pebble_one.c: the hand outlines and the
+# dial positions pre-rotated to the 60 tick positions, so the face does no
+# trig and no gpath rotation at runtime.
+#
+# The hand shapes and radii are read from pebble_one.c itself. Only the first
+# quadrant (steps 0-14) is emitted; rotating by a quarter turn maps (x, y) to
+# (-y, x) exactly, so the face folds the other three quadrants in.
+#
+#   python gen_geometry.py src/pebble_one.c > geometry.auto.h
+
+import math
+import re
+import sys
+
+TRIG_MAX_RATIO = 0xffff
+TRIG_MAX_ANGLE = 0x10000
+STEPS = 60
+QUADRANT = STEPS // 4
+
+
+def angle(step):
+    # the face used THREESIXTY * step / 60, which truncates
+    return TRIG_MAX_ANGLE * step // STEPS
+
+
+def sin_lookup(step):
+    return int(round(math.sin(2 * math.pi * angle(step) / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO))
+
+
+def cos_lookup(step):
+    return int(round(math.cos(2 * math.pi * angle(step) / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO))
+
+
+def div(a, b):
+    # C integer division truncates towards zero
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+
+def rotate(point, step):
+    # same transform as gpath_rotate_to
+    x, y = point
+    c, s = cos_lookup(step), sin_lookup(step)
+    return div(x * c - y * s, TRIG_MAX_RATIO), div(x * s + y * c, TRIG_MAX_RATIO)
+
+
+def radial(radius, step):
+    # a point at radius from the center, clockwise from 12 o'clock
+    return div(radius * sin_lookup(step), TRIG_MAX_RATIO), div(-radius * cos_lookup(step), TRIG_MAX_RATIO)
+
+
+def parse(source):
+    paths = {}
+    for m in re.finditer(r'const GPathInfo (\w+)_POINTS = \{\s*(\d+),\s*\(GPoint \[\]\) \{(.*?)\}\s*\};', source, re.S):
+        points = [(int(x), int(y)) for x, y in re.findall(r'\{\s*(-?\d+),\s*(-?\d+)\}', m.group(3))]
+        assert len(points) == int(m.group(2)), m.group(1)
+        paths[m.group(1)] = points
+    radii = {}
+    for m in re.finditer(r'#define (\w+_RADIUS)\s+PBL_IF_ROUND_ELSE\(\s*(\d+),\s*(\d+)\)', source):
+        radii[m.group(1)] = (int(m.group(2)), int(m.group(3)))
+    return paths, radii
+
+
+def dot(radius, i):
+    # the dial dots, counterclockwise from 3 o'clock in steps of THREESIXTY / 12
+    a = i * (TRIG_MAX_ANGLE // 12)
+    c = int(round(math.cos(2 * math.pi * a / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO))
+    s = int(round(math.sin(2 * math.pi * a / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO))
+    return div(radius * c, TRIG_MAX_RATIO), -div(radius * s, TRIG_MAX_RATIO)
+
+
+def table(name, rows, width, length=QUADRANT):
+    def point(p):
+        assert -128 <= p[0] < 128 and -128 <= p[1] < 128, name
+        return '{%4d,%4d}' % p
+    lines = ['static const int8_t %s[%d]%s[2] = {' % (name, length, '[%d]' % width if width else '')]
+    for row in rows:
+        if width:
+            lines.append('  {' + ', '.join(point(p) for p in row) + '},')
+        else:
+            lines.append('  ' + point(row) + ',')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main(filename):
+    paths, radii = parse(open(filename).read())
+    out = ['// generated by tools/gen_geometry.py from %s, do not edit' % filename.split('/')[-1].split('\\')[-1],
+           '',
+           '#define GEOMETRY_STEPS %d' % STEPS,
+           '#define GEOMETRY_QUADRANT %d' % QUADRANT,
+           '']
+    for name in ('HOUR', 'MIN', 'SEC'):
+        points = paths[name]
+        out.append('#define %s_POINT_COUNT %d' % (name, len(points)))
+        out.append(table(name + '_TABLE', [[rotate(p, step) for p in points] for step in range(QUADRANT)], len(points)))
+        out.append('')
+    for guard, index in (('#ifdef PBL_ROUND', 0), ('#else', 1)):
+        out.append(guard)
+        out.append(table('DOT_CENTERS', [dot(radii['DOTS_RADIUS'][index], i) for i in range(12)], 0, 12))
+        out.append(table('HAND_START_TABLE', [radial(radii['DOTS_RADIUS'][index], step) for step in range(QUADRANT)], 0))
+        out.append(table('SEC_END_TABLE', [radial(radii['SEC_RADIUS'][index], step) for step in range(QUADRANT)], 0))
+    out.append('#endif')
+    sys.stdout.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main(sys.argv[1])